@@ -0,0 +1,90 @@
+#!/bin/sh
+# Benchmark harness: runs a fixed matrix of scenarios (loss, corruption,
+# arrival rate, window size) with a pinned RNG seed and compares the CSV
+# output against bench_baseline.csv.
+#
+# Two kinds of check:
+#   - determinism: with a pinned seed every counter column (messages
+#     sent, resends, deliveries, simulated end time, event count) must
+#     match the baseline exactly; any drift means protocol behaviour
+#     changed and the baseline needs a deliberate regeneration.
+#   - performance: wall-clock events/sec of the event loop must stay
+#     above BENCH_THRESHOLD (default 0.5) times the baseline figure.
+#     events/sec is machine-dependent - regenerate the baseline with
+#     `make baseline` when moving to new hardware, and keep the
+#     threshold loose enough to absorb noisy neighbours.
+#
+# Usage: bench.sh            run the matrix and compare
+#        bench.sh --baseline rewrite bench_baseline.csv
+
+BIN=${BIN:-./sim}
+BASELINE=${BASELINE:-bench_baseline.csv}
+THRESHOLD=${BENCH_THRESHOLD:-0.5}
+
+run_matrix() {
+    # The channel serializes each direction (every packet delays the
+    # next by 1-10 units), so offered load past ~1 packet per 6 units
+    # queues heavily; the RTO cap scales with the window so such cells
+    # back off and terminate rather than diverge, but their runtime is
+    # queueing-dominated and noisy.  Keep the matrix in the sustained
+    # regime (mean inter-arrival >= 20, loss <= 0.2) so the perf
+    # threshold stays meaningful.
+    "$BIN" -n 2000 -s 1234 -l 0.0,0.1,0.2 -c 0.0,0.1 -g 20,50 -w 8,16
+}
+
+if [ "$1" = "--baseline" ]; then
+    run_matrix > "$BASELINE" || exit 1
+    echo "wrote $BASELINE"
+    exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+    echo "no $BASELINE; run 'make baseline' first" >&2
+    exit 1
+fi
+
+run_matrix > bench_current.csv || exit 1
+
+# columns: 1 loss, 2 corrupt, 3 lambda, 4 window, 5 nsimmax, 6 sent,
+# 7 window_full, 8 new_ACKs, 9 resent, 10 received, 11 delivered,
+# 12 sim_time, 13 events, 14 events_per_sec
+awk -F, -v thr="$THRESHOLD" '
+NR == FNR {
+    if (FNR > 1) {
+        key = $1 "," $2 "," $3 "," $4
+        det[key] = $5 "," $6 "," $7 "," $8 "," $9 "," $10 "," $11 "," $12 "," $13
+        eps[key] = $14
+    }
+    next
+}
+FNR > 1 {
+    key = $1 "," $2 "," $3 "," $4
+    cur = $5 "," $6 "," $7 "," $8 "," $9 "," $10 "," $11 "," $12 "," $13
+    if (!(key in det)) {
+        printf "FAIL no baseline row for (%s)\n", key
+        fail = 1
+        next
+    }
+    if (cur != det[key]) {
+        printf "FAIL determinism (%s): got [%s] want [%s]\n", key, cur, det[key]
+        fail = 1
+        next
+    }
+    if (eps[key] > 0 && $14 < thr * eps[key]) {
+        printf "FAIL perf (%s): %.0f events/s, baseline %.0f (threshold %.2fx)\n",
+               key, $14, eps[key], thr
+        fail = 1
+        next
+    }
+    printf "ok (%s): %.0f events/s (baseline %.0f), goodput %.3f msgs/unit, %d resent\n",
+           key, $14, eps[key], ($12 > 0) ? $11 / $12 : 0, $9
+}
+END { exit fail }
+' "$BASELINE" bench_current.csv
+status=$?
+if [ $status -eq 0 ]; then
+    echo "bench: all scenarios passed"
+else
+    echo "bench: FAILURES (see above)" >&2
+fi
+exit $status
@@ -1,478 +1,2172 @@
-/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
-   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-   the emulator, you're welcome to look at the code - but again, you should have
-   to, and you defeinitely should not have to modify
-   This file contains the code that emulates the network.  It does not
-   implement any of the Go-Back-N protocol.
-   ********************************************************************
-
-   ******************************************************************
-   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-   The code below emulates the layer 3 and below network environment:
-   - emulates the tranmission and delivery (possibly with bit-level corruption
-   and packet loss) of packets across the layer 3/4 interface
-   - handles the starting/stopping of a timer, and generates timer
-   interrupts (resulting in calling students timer handler).
-   - generates message to be sent (passed from later 5 to 4)
-
-   Network properties:
-   - one way network delay averages five time units (longer if there
-   are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-   or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-   (although some can be lost).
-
-   Modifications (6/6/2008 - CLP): 
-   - removed bidirectional GBN code and other code not used by prac. 
-   - removed hard coded maximum random number, use library defined
-   RAND_MAX value 
-   - simulator stops when no events are left rather than stopping as
-   soon as n packets are sent.
-   - fixed C style to adhere to current programming style
-
-   ********************************************************************* */
-#include <stdlib.h>
-#include <stdio.h>
-#include "emulator.h"
-#include "sr.h"
-
-struct event {
-  float evtime;           /* event time */
-  int evtype;             /* event type code */
-  int eventity;           /* entity where event occurs */
-  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
-};
-
-struct event *evlist = NULL;   /* the event list */
-
-/* possible events: */
-#define  TIMER_INTERRUPT 0  
-#define  FROM_LAYER5     1
-#define  FROM_LAYER3     2
-
-#define  OFF             0
-#define  ON              1
-
-int TRACE = 3;
-
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
-
-/****************************************************************************/
-/* jimsrand(): return a double in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
-/****************************************************************************/
-double jimsrand(void) 
-{
-  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-  double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
-    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
-  return(x);
-}  
-
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
-
-void insertevent(struct event *p)
-{
-  struct event *q,*qold;
-
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
-  }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
-  }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
-    if (q==NULL) {   /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
-      evlist = p;
-    }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
-    }
-  }
-}
-
-void generate_next_arrival(void)
-{
-  double x;
-  struct event *evptr;
-
-  if (TRACE>2)
-    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
- 
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-  /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + x;
-  evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
-    evptr->eventity = B;
-  else
-    evptr->eventity = A;
-  insertevent(evptr);
-} 
-
-void printevlist(void)
-{
-  struct event *q;
-  printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
-  }
-  printf("--------------\n");
-}
-
-void init(void)                         /* initialize the simulator */
-{
-  float sum, avg;
-  int i;
-
-  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-  printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
-  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
-  printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
-    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
-  }
-  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
-  printf("Enter TRACE:");
-  scanf("%d",&TRACE);
-
-
-  srand(9999);              /* init random number generator */
-  sum = 0.0;                /* test random number generator for students */
-  for (i=0; i<1000; i++)
-    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
-  avg = sum/1000.0;
-  if (avg < 0.25 || avg > 0.75) {
-    printf("It is likely that random number generation on your machine\n" ); 
-    printf("is different from what this emulator expects.  Please take\n");
-    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-    exit(EXIT_FAILURE);
-  }
-
-  /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;  
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
-
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
-
-  time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
-}
-
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
-/* A or B is trying to stop timer */
-{
-  struct event *q;
-
-  if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
-}
-
-
-void starttimer(int AorB, double increment)
-/* A or B is trying to start timer */
-{
-
-  struct event *q;
-  struct event *evptr;
-
-  if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
-  /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
-    }
- 
-  /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + increment;
-  evptr->evtype =  TIMER_INTERRUPT;
-   
- 
-  evptr->eventity = AorB;
-  insertevent(evptr);
-} 
-
-
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
-{
-  struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
-  int i;
-
-  ntolayer3++;
-
-  /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
-    return;
-  }  
-
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
-  }
-
-  /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
-  evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
-  /* finally, compute the arrival time of packet at the other end.
-     medium can not reorder, so make sure packet arrives between 1 and 10
-     time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
-
-
-  /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
-    else
-      mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
-  }  
-
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
-} 
-
-void tolayer5(int AorB, char datasent[20])
-{
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A) 
-      printf("A: ");
-    else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
-  }
-  messages_delivered++;
-}
-
-int main(void)
-{
-  struct event *eventptr;
-  struct msg  msg2give;
-  struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
-  while (1) {
-    eventptr = evlist;            /* get next event to simulate */
-    if (eventptr==NULL)
-      goto terminate;
-    evlist = evlist->next;        /* remove this event from event list */
-    if (evlist!=NULL)
-      evlist->prev=NULL;
-    if (TRACE>=2) {
-      printf("\nEVENT time: %f,",eventptr->evtime);
-      printf("  type: %d",eventptr->evtype);
-      if (eventptr->evtype==0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype==1)
-        printf(", fromlayer5 ");
-      else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n",eventptr->eventity);
-    }
-    time = eventptr->evtime;        /* update time to next event time */
-    if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
-        generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
-        nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
-      }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
-    }
-    else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
-      else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
-    }
-    else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
-      else
-        B_timerinterrupt();
-    }
-    else  {
-      printf("INTERNAL PANIC: unknown event type \n");
-    }
-    free(eventptr);
-  }
-
- terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
-  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
+/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
+   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
+   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
+   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
+   the emulator, you're welcome to look at the code - but again, you should have
+   to, and you defeinitely should not have to modify
+   This file contains the code that emulates the network.  It does not
+   implement any of the Go-Back-N protocol.
+   ********************************************************************
+
+   ******************************************************************
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
+   The code below emulates the layer 3 and below network environment:
+   - emulates the tranmission and delivery (possibly with bit-level corruption
+   and packet loss) of packets across the layer 3/4 interface
+   - handles the starting/stopping of a timer, and generates timer
+   interrupts (resulting in calling students timer handler).
+   - generates message to be sent (passed from later 5 to 4)
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Modifications (6/6/2008 - CLP): 
+   - removed bidirectional GBN code and other code not used by prac. 
+   - removed hard coded maximum random number, use library defined
+   RAND_MAX value 
+   - simulator stops when no events are left rather than stopping as
+   soon as n packets are sent.
+   - fixed C style to adhere to current programming style
+
+   ********************************************************************* */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include "emulator.h"
+#include "sr.h"
+#include "log.h"
+#include "stats.h"
+#include "results.h"
+
+struct event {
+  float evtime;           /* event time */
+  int evtype;             /* event type code */
+  int eventity;           /* entity where event occurs */
+  int evkey;              /* timer key (seqnum); -1 for the legacy per-entity timer */
+  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  int heappos;            /* index of this event in evheap, for O(log n) removal */
+};
+
+/* The pending-event set is kept as a binary min-heap ordered on evtime,
+   rather than the sorted linked list of earlier versions.  Insert and
+   pop are O(log n), and an event that remembers its heap slot (heappos)
+   can be unlinked in O(log n) as well - the old list walk in stoptimer()
+   was the dominant cost of large-window simulations. */
+static __thread struct event **evheap = NULL;  /* heap of pointers to pending events */
+static __thread int evheap_len = 0;            /* number of events in the heap */
+static __thread int evheap_cap = 0;            /* allocated slots in evheap */
+
+/* Layer-5 arrivals are pre-generated in batches rather than one at a
+   time: at high lambda the arrival stream dominates insertevent() load,
+   and a batch of cumulative inter-arrival times inserts in ascending
+   order, where the heap sift usually stops after one comparison. */
+#define ARRIVAL_BATCH 32  /* arrivals generated per refill */
+
+static __thread int arrivals_pending = 0;     /* FROM_LAYER5 events still queued */
+static __thread float arrival_horizon = 0.0;  /* time of the last arrival generated */
+
+/* Multi-flow engine (-F): nflows independent SR connections share the
+   channel.  Entities are numbered flow*2 + role, so a flow's sender is
+   even and its receiver odd, and the classic pair arithmetic (partner =
+   entity ^ 1) still holds.  Protocol code stays role-based: the layer 3,
+   layer 5 and timer entry points map (current flow, role) to the entity,
+   and with one flow the mapping is the identity. */
+static int nflows = 1;               /* flow count, set once from the command line */
+static __thread int cur_flow = 0;    /* flow of the event being dispatched */
+
+/* map a role (A/B) from protocol code onto the current flow's entity */
+static int flow_ent(int AorB)
+{
+  return (cur_flow << 1) | (AorB & 1);
+}
+
+/* one outstanding timer per entity: remember its event so that
+   stoptimer() can cancel without searching the whole queue */
+static __thread struct event **timer_ev = NULL;
+
+/* keyed timers: one outstanding timer per (entity, seqnum), used by the
+   per-packet retransmission timers.  Handle tables grow on demand to
+   the sequence space in use. */
+static __thread struct event ***keyed_timer = NULL;
+static __thread int *keyed_timer_cap = NULL;
+
+/* Fixed-block pools for the two object types churned on every packet
+   transit.  Objects are carved from POOL_CHUNK-sized slabs and recycled
+   through an intrusive free list (the first pointer-size bytes of a free
+   object hold the list link), so steady-state simulation makes no
+   malloc()/free() calls at all.  Slabs are never returned to the system;
+   the working set is bounded by the peak number of in-flight events. */
+#define POOL_CHUNK 1024   /* objects obtained from malloc per refill */
+
+static __thread void *ev_freelist = NULL;
+static __thread void *pkt_freelist = NULL;
+
+static void *pool_alloc(void **freelist, size_t objsize)
+{
+  void *p;
+  char *chunk;
+  int i;
+
+  if (*freelist == NULL) {
+    chunk = malloc(POOL_CHUNK * objsize);
+    if (chunk == NULL) {
+      printf("memory allocation for object pool failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < POOL_CHUNK; i++) {
+      *(void **)(chunk + i*objsize) = *freelist;
+      *freelist = chunk + i*objsize;
+    }
+  }
+  p = *freelist;
+  *freelist = *(void **)p;
+  return p;
+}
+
+static void pool_free(void **freelist, void *p)
+{
+  *(void **)p = *freelist;
+  *freelist = p;
+}
+
+static struct event *event_alloc(void)
+{
+  return pool_alloc(&ev_freelist, sizeof(struct event));
+}
+
+static void event_free(struct event *p)
+{
+  pool_free(&ev_freelist, p);
+}
+
+/* packet pool alloc/free are exported so the protocol code can build
+   packets in place and hand ownership through the zero-copy path */
+struct pkt *pkt_alloc(void)
+{
+  return pool_alloc(&pkt_freelist, sizeof(struct pkt));
+}
+
+void pkt_free(struct pkt *p)
+{
+  pool_free(&pkt_freelist, p);
+}
+
+/* possible events: */
+#define  TIMER_INTERRUPT 0
+#define  FROM_LAYER5     1
+#define  FROM_LAYER3     2
+
+/* Event capture and deterministic replay.  In capture mode every event
+   popped by the main loop is appended to a binary trace as one fixed
+   48-byte record; in replay mode that trace is fed straight back into
+   the protocol entry points with the RNG, event heap and timers all
+   bypassed - the channel's decisions are already baked into the
+   recorded event stream - so a multi-million-event failure reproduces
+   in seconds and can be bisected by event index (-e). */
+struct trace_ev {
+  float evtime;
+  int evtype;
+  int eventity;
+  int evkey;
+  struct pkt pkt;        /* packet contents; zeroed unless FROM_LAYER3 */
+};
+
+static FILE *capture_file;
+static __thread int replaying;
+
+#define  OFF             0
+#define  ON              1
+
+int TRACE = 3;
+int bidirectional = 0;
+
+/* statistics updated by GBN */
+__thread int window_full;   /* count of the number of messages dropped due to full window */
+__thread int total_ACKs_received;
+__thread int packets_resent;       /* count of the number of packets resent  */
+__thread int new_ACKs;           /* count of the number of acks correctly received */
+__thread int packets_received;  /* count of the packets received by receiver */
+
+/* statistics updated by emulator */
+static __thread int packets_lost;
+static __thread int packets_corrupt;
+static __thread int packets_sent;
+static __thread int packets_timeout;
+static __thread int messages_delivered;
+
+static __thread long events_processed;     /* events popped by run_loop, for benchmarks */
+static __thread int nsim = 0;              /* number of messages from 5 to 4 so far */
+static __thread int nsimmax = 0;           /* number of msgs to generate, then stop */
+static int rngseed = 9999;        /* srand() seed, settable in batch mode */
+static __thread float sim_time = 0.000;
+
+/* current simulated time; used by the binary trace log to stamp records */
+float sim_now(void)
+{
+  return sim_time;
+}
+static __thread float lossprob;            /* probability that a packet is dropped  */
+static __thread float corruptprob;   /* probability that one bit is packet is flipped */
+static __thread int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
+static __thread float lambda;        /* arrival rate of messages from layer 5 */
+
+/* variable-length workload (-m min,max): each layer 5 message draws a
+   uniform size in [msgsize_min, msgsize_max] bytes and is segmented
+   across window slots; 0 max keeps the classic fixed 20-byte messages */
+static __thread int msgsize_min = 0;
+static __thread int msgsize_max = 0;
+
+static __thread int   ntolayer3;           /* number sent into layer 3 */
+static __thread int   nlost;               /* number lost in media */
+static __thread int ncorrupt;              /* number corrupted by media*/
+
+/* latest scheduled arrival time per destination entity.  The channel
+   cannot reorder, so a new packet arrives after every packet already in
+   flight toward the same entity; tracking that edge here makes the
+   anchor an O(1) read instead of the old full scan of the event heap
+   per transmitted packet.  Sized 2*nflows by engine_alloc(). */
+static __thread float *chan_lastime = NULL;
+
+/* shared channel bandwidth (-W, packets per time unit; 0 = unlimited).
+   All flows sending toward the same side contend for one link: each
+   packet occupies it for 1/chan_bw before its propagation delay, and
+   chan_busy tracks when the link frees up per direction. */
+static float chan_bw = 0.0;
+static __thread float chan_busy[2];
+
+/* per-flow counters for the multi-flow report */
+static __thread int *flow_sent = NULL;       /* packets into layer 3 */
+static __thread int *flow_delivered = NULL;  /* messages to layer 5 */
+
+/* lazily size the per-thread entity/flow tables; worker threads in the
+   replication engine allocate their own on first run */
+static void engine_alloc(void)
+{
+  if (timer_ev != NULL)
+    return;
+  timer_ev = calloc(2*nflows, sizeof(struct event *));
+  keyed_timer = calloc(2*nflows, sizeof(struct event **));
+  keyed_timer_cap = calloc(2*nflows, sizeof(int));
+  chan_lastime = calloc(2*nflows, sizeof(float));
+  flow_sent = calloc(nflows, sizeof(int));
+  flow_delivered = calloc(nflows, sizeof(int));
+  if (timer_ev == NULL || keyed_timer == NULL || keyed_timer_cap == NULL ||
+      chan_lastime == NULL || flow_sent == NULL || flow_delivered == NULL) {
+    printf("memory allocation for the flow tables failed.");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* cursor into the -D trace:FILE delay samples (see the delay model
+   block above tolayer3_pkt); per run, like the channel edge above */
+static __thread int delay_trace_pos = 0;
+
+/****************************************************************************/
+/* Random number generation is isolated here.  The generator is PCG32       */
+/* (64-bit LCG state with an output permutation): one multiply plus a few   */
+/* shifts per draw, far better statistical quality than libc rand(), and a  */
+/* distinct odd increment selects an independent sequence - which gives us  */
+/* named streams.  Each purpose (arrival spacing, loss draws, corruption    */
+/* draws, channel delay) draws from its own stream, so pinning one stream's */
+/* seed (-r) replays the identical loss pattern across protocol variants    */
+/* while everything else varies: common-random-numbers variance reduction.  */
+/* State is per thread, so concurrent replications stay independent.        */
+/****************************************************************************/
+enum rng_stream {
+  RNG_ARRIVAL,    /* layer 5 inter-arrival gaps and direction choice */
+  RNG_LOSS,       /* per-packet loss draw */
+  RNG_CORRUPT,    /* per-packet corruption draw and field choice */
+  RNG_DELAY,      /* per-packet channel transit time */
+  RNG_MSGSIZE,    /* variable-length workload: per-message size draw */
+  RNG_MISC,       /* anything else (the interactive sanity check) */
+  RNG_NSTREAMS
+};
+
+static const char *rng_stream_name[RNG_NSTREAMS] = {
+  "arrivals", "loss", "corruption", "delay", "msgsize", "misc"
+};
+
+/* distinct odd increments select the per-stream sequences */
+static const unsigned long long rng_inc[RNG_NSTREAMS] = {
+  0x14057b7ef767814fULL, 0xda3e39cb94b95bdbULL, 0x9e3779b97f4a7c15ULL,
+  0xd1b54a32d192ed03ULL, 0x8cb92ba72f3d8dd7ULL, 0x2545f4914f6cdd1dULL
+};
+
+static __thread unsigned long long rngstate[RNG_NSTREAMS];
+
+/* seeds pinned from the command line (-r stream=seed); -1 = follow -s */
+static long long rng_pinned[RNG_NSTREAMS] = { -1, -1, -1, -1, -1, -1 };
+
+static unsigned int rng_next(int st)
+{
+  unsigned long long old = rngstate[st];
+  unsigned int xorshifted, rot;
+
+  rngstate[st] = old*6364136223846793005ULL + rng_inc[st];
+  xorshifted = (unsigned int)(((old >> 18) ^ old) >> 27);
+  rot = (unsigned int)(old >> 59);
+  return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+/* uniform draw in [0,1) from one named stream */
+static double rng_uniform(int st)
+{
+  double x = rng_next(st) * (1.0 / 4294967296.0);
+
+  if (TRACE > 3)
+    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  return x;
+}
+
+static void sim_srand(unsigned int seed)
+{
+  unsigned long long s;
+  int st;
+
+  for (st = 0; st < RNG_NSTREAMS; st++) {
+    s = (rng_pinned[st] >= 0) ? (unsigned long long)rng_pinned[st] : seed;
+    /* standard PCG seeding: burn one step either side of the seed add */
+    rngstate[st] = 0;
+    rng_next(st);
+    rngstate[st] += s;
+    rng_next(st);
+  }
+}
+
+/* legacy entry point: a draw from the catch-all stream */
+double jimsrand(void)
+{
+  return rng_uniform(RNG_MISC);
+}
+
+/********************* EVENT HANDLINE ROUTINES *******/
+/*  The next set of routines handle the event list   */
+/*****************************************************/
+
+/* move the event at slot i towards the root until the heap order holds */
+static void evheap_siftup(int i)
+{
+  struct event *p = evheap[i];
+
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (evheap[parent]->evtime <= p->evtime)
+      break;
+    evheap[i] = evheap[parent];
+    evheap[i]->heappos = i;
+    i = parent;
+  }
+  evheap[i] = p;
+  p->heappos = i;
+}
+
+/* move the event at slot i towards the leaves until the heap order holds */
+static void evheap_siftdown(int i)
+{
+  struct event *p = evheap[i];
+
+  for (;;) {
+    int child = 2*i + 1;
+    if (child >= evheap_len)
+      break;
+    if (child+1 < evheap_len && evheap[child+1]->evtime < evheap[child]->evtime)
+      child++;
+    if (p->evtime <= evheap[child]->evtime)
+      break;
+    evheap[i] = evheap[child];
+    evheap[i]->heappos = i;
+    i = child;
+  }
+  evheap[i] = p;
+  p->heappos = i;
+}
+
+/* remove and return the earliest pending event, or NULL if none remain */
+static struct event *evheap_pop(void)
+{
+  struct event *p;
+
+  if (evheap_len == 0)
+    return NULL;
+  p = evheap[0];
+  evheap_len--;
+  if (evheap_len > 0) {
+    evheap[0] = evheap[evheap_len];
+    evheap_siftdown(0);
+  }
+  if (p->evtype == TIMER_INTERRUPT) {
+    /* timer has fired; its handle is stale */
+    if (p->evkey < 0)
+      timer_ev[p->eventity] = NULL;
+    else if (p->evkey < keyed_timer_cap[p->eventity])
+      keyed_timer[p->eventity][p->evkey] = NULL;
+  }
+  return p;
+}
+
+/* unlink an arbitrary event from the middle of the heap in O(log n) */
+static void evheap_remove(struct event *p)
+{
+  int i = p->heappos;
+  struct event *moved;
+
+  evheap_len--;
+  if (i < evheap_len) {
+    moved = evheap[evheap_len];
+    evheap[i] = moved;
+    moved->heappos = i;
+    /* the replacement may need to move in either direction */
+    evheap_siftup(i);
+    evheap_siftdown(moved->heappos);
+  }
+}
+
+void insertevent(struct event *p)
+{
+  LOG(LOG_EVQ, 3, LOGC_EVQ_INSERT, p->evtype, p->eventity, p->evtime);
+  if (evheap_len == evheap_cap) {
+    evheap_cap = (evheap_cap == 0) ? 64 : evheap_cap*2;
+    evheap = realloc(evheap, evheap_cap * sizeof(struct event *));
+    if (evheap == NULL) {
+      printf("memory allocation for event heap failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  evheap[evheap_len] = p;
+  p->heappos = evheap_len;
+  evheap_len++;
+  evheap_siftup(p->heappos);
+  if (p->evtype == TIMER_INTERRUPT && p->evkey < 0)
+    timer_ev[p->eventity] = p;   /* keyed timers register in starttimer_seq() */
+}
+
+void generate_next_arrival(void)
+{
+  double x;
+  struct event *evptr;
+  int n;
+
+  if (arrivals_pending > 0)     /* the current batch isn't drained yet */
+    return;
+
+  /* refill: pre-compute the next batch of inter-arrival gaps and insert
+     the arrivals in one ascending pass.  Capped so we generate at most
+     one arrival past the last message, as the one-at-a-time code did. */
+  n = nsimmax + 1 - nsim;
+  if (n > ARRIVAL_BATCH)
+    n = ARRIVAL_BATCH;
+  if (arrival_horizon < sim_time)
+    arrival_horizon = sim_time;
+
+  if (TRACE>2)
+    printf("          GENERATE NEXT ARRIVAL: creating %d new arrivals\n", n);
+
+  while (n-- > 0) {
+    x = lambda*rng_uniform(RNG_ARRIVAL)*2;  /* x is uniform on [0,2*lambda] */
+    /* having mean of lambda        */
+    arrival_horizon += x;
+    evptr = event_alloc();
+    evptr->evtime =  arrival_horizon;
+    evptr->evtype =  FROM_LAYER5;
+    evptr->evkey = -1;
+    if (nflows > 1) {
+      /* spread the offered load across flows uniformly; every message
+         enters at its flow's sender (the even entity) */
+      int f = (int)(rng_uniform(RNG_ARRIVAL) * nflows);
+      if (f >= nflows)
+        f = nflows - 1;
+      evptr->eventity = f << 1;
+    }
+    else if (bidirectional && (rng_uniform(RNG_ARRIVAL)>0.5) )
+      evptr->eventity = B;
+    else
+      evptr->eventity = A;
+    insertevent(evptr);
+    arrivals_pending++;
+  }
+}
+
+void printevlist(void)
+{
+  int i;
+  printf("--------------\nEvent List Follows:\n");
+  /* heap order, not time order - adequate for eyeballing the queue */
+  for (i = 0; i < evheap_len; i++) {
+    printf("Event time: %f, type: %d entity: %d\n",
+           evheap[i]->evtime, evheap[i]->evtype, evheap[i]->eventity);
+  }
+  printf("--------------\n");
+}
+
+/* reset all per-run state: statistics, clock, RNG stream and the first
+   arrival.  Shared by the interactive path and the batch/sweep driver so
+   one process can run many cells without re-paying process startup. */
+static void reset_run(void)
+{
+  int i;
+
+  /* NB: callers seed the RNG themselves; the interactive path burns
+     1000 draws on its sanity check first, and the sweep driver reseeds
+     before every cell so cells are independent of grid order */
+
+  /* initialise statistics */
+  window_full = 0;
+  total_ACKs_received = 0;
+  packets_resent = 0;
+  new_ACKs = 0;
+  packets_received = 0;
+  packets_lost = 0;
+  packets_corrupt = 0;
+  packets_sent = 0;
+  packets_timeout = 0;
+  messages_delivered = 0;
+
+  ntolayer3 = 0;
+  nlost = 0;
+  ncorrupt = 0;
+
+  nsim = 0;
+  sim_time=0.0;                /* initialize time to 0.0 */
+  arrivals_pending = 0;
+  arrival_horizon = 0.0;
+  engine_alloc();
+  for (i = 0; i < 2*nflows; i++)
+    chan_lastime[i] = 0.0;
+  for (i = 0; i < nflows; i++) {
+    flow_sent[i] = 0;
+    flow_delivered[i] = 0;
+  }
+  chan_busy[A] = 0.0;
+  chan_busy[B] = 0.0;
+  cur_flow = 0;
+  delay_trace_pos = 0;
+  stats_reset();
+  generate_next_arrival();     /* initialize event list */
+}
+
+void init(void)                         /* initialize the simulator */
+{
+  float sum, avg;
+  int i;
+  int windowarg, seqspacearg;
+
+  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+  printf("Enter the number of messages to simulate: ");
+  scanf("%d",&nsimmax);
+  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
+  scanf("%f",&lossprob);
+  printf("Enter packet corruption probability [0.0 for no corruption]:");
+  scanf("%f",&corruptprob);
+  if (lossprob != 0.0 || corruptprob != 0.0) {
+    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
+    scanf("%d",&corruptdirection);
+  }
+  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
+  scanf("%f",&lambda);
+  printf("Enter send window size [0 for default, rounded up to a power of 2]:");
+  scanf("%d",&windowarg);
+  printf("Enter sequence space [0 for 2 x window size]:");
+  scanf("%d",&seqspacearg);
+  printf("Enter TRACE:");
+  scanf("%d",&TRACE);
+
+  SR_configure(windowarg, seqspacearg);
+
+
+  sim_srand(rngseed);       /* init random number generator */
+  sum = 0.0;                /* test random number generator for students */
+  for (i=0; i<1000; i++)
+    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
+  avg = sum/1000.0;
+  if (avg < 0.25 || avg > 0.75) {
+    printf("It is likely that random number generation on your machine\n" );
+    printf("is different from what this emulator expects.  Please take\n");
+    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+    exit(EXIT_FAILURE);
+  }
+
+  reset_run();
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB)
+/* A or B is trying to stop timer */
+{
+  struct event *q;
+
+  AorB = flow_ent(AorB);
+  if (replaying)
+    return;   /* timer fires come from the recorded trace */
+  if (TRACE>1)
+    printf("          STOP TIMER: stopping timer at %f\n",sim_time);
+  q = timer_ev[AorB];
+  if (q != NULL) {
+    evheap_remove(q);
+    timer_ev[AorB] = NULL;
+    event_free(q);
+    return;
+  }
+  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+}
+
+
+void starttimer(int AorB, double increment)
+/* A or B is trying to start timer */
+{
+
+  struct event *evptr;
+
+  AorB = flow_ent(AorB);
+  if (replaying)
+    return;
+  if (TRACE>1)
+    printf("          START TIMER: starting timer at %f\n",sim_time);
+  /* be nice: check to see if timer is already started, if so, then  warn */
+  if (timer_ev[AorB] != NULL) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+
+  /* create future event for when timer goes off */
+  evptr = event_alloc();
+  evptr->evtime =  sim_time + increment;
+  evptr->evtype =  TIMER_INTERRUPT;
+  evptr->evkey = -1;
+   
+ 
+  evptr->eventity = AorB;
+  insertevent(evptr);
+} 
+
+
+/* reschedule the running timer for AorB in place: the pending timer
+   event is repositioned in the heap rather than freed and reinserted,
+   so the stop+start pair on the ACK hot path becomes one O(log n)
+   operation with no allocator traffic.  Falls back to starttimer() if
+   no timer is running, so callers need no branch. */
+void resettimer(int AorB, double increment)
+{
+  struct event *q;
+
+  AorB = flow_ent(AorB);
+  q = timer_ev[AorB];
+
+  if (replaying)
+    return;
+  if (TRACE>1)
+    printf("          RESET TIMER: resetting timer at %f\n",sim_time);
+  if (q == NULL) {
+    starttimer(AorB, increment);
+    return;
+  }
+  q->evtime = sim_time + increment;
+  evheap_siftup(q->heappos);
+  evheap_siftdown(q->heappos);
+}
+
+/* per-packet timers: one independent timer per (entity, seqnum), so a
+   Selective Repeat sender can time every unACKed packet in its window
+   rather than only the one at the base.  Expiry calls
+   A_packettimeout()/B_packettimeout() with the key.  Start, cancel and
+   lookup are O(1) table operations plus the O(log n) heap work. */
+
+static void keyed_timer_reserve(int AorB, int key)
+{
+  int cap = keyed_timer_cap[AorB];
+  int newcap;
+
+  if (key < cap)
+    return;
+  newcap = (cap == 0) ? 64 : cap;
+  while (newcap <= key)
+    newcap *= 2;
+  keyed_timer[AorB] = realloc(keyed_timer[AorB], newcap * sizeof(struct event *));
+  if (keyed_timer[AorB] == NULL) {
+    printf("memory allocation for timer table failed.");
+    exit(EXIT_FAILURE);
+  }
+  while (cap < newcap)
+    keyed_timer[AorB][cap++] = NULL;
+  keyed_timer_cap[AorB] = newcap;
+}
+
+void starttimer_seq(int AorB, int seqnum, double increment)
+{
+  struct event *evptr;
+
+  AorB = flow_ent(AorB);
+  if (replaying)
+    return;
+  if (TRACE>1)
+    printf("          START TIMER: starting timer for %d at %f\n",seqnum,sim_time);
+  keyed_timer_reserve(AorB, seqnum);
+  if (keyed_timer[AorB][seqnum] != NULL) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+
+  evptr = event_alloc();
+  evptr->evtime =  sim_time + increment;
+  evptr->evtype =  TIMER_INTERRUPT;
+  evptr->evkey = seqnum;
+  evptr->eventity = AorB;
+  insertevent(evptr);
+  keyed_timer[AorB][seqnum] = evptr;
+}
+
+void stoptimer_seq(int AorB, int seqnum)
+{
+  struct event *q;
+
+  AorB = flow_ent(AorB);
+  if (replaying)
+    return;
+  if (TRACE>1)
+    printf("          STOP TIMER: stopping timer for %d at %f\n",seqnum,sim_time);
+  q = (seqnum < keyed_timer_cap[AorB]) ? keyed_timer[AorB][seqnum] : NULL;
+  if (q != NULL) {
+    evheap_remove(q);
+    keyed_timer[AorB][seqnum] = NULL;
+    event_free(q);
+    return;
+  }
+  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+}
+
+
+/************************** TOLAYER3 ***************/
+/* zero-copy entry: the caller passes a pointer to its packet and the
+   channel makes the one unavoidable copy into a pool packet (the copy
+   cannot be elided entirely: the channel may corrupt or delay its copy
+   while the sender keeps the original for retransmission). */
+/* Pluggable channel delay model (-D).  Every model returns one transit
+   delay; the FIFO constraint (arrive after everything already in flight
+   to the same entity) is enforced by the caller, so models never touch
+   the scheduler.  All random models draw from RNG_DELAY, so a pinned
+   delay stream still gives common random numbers across variants. */
+enum delay_model_id {
+  DELAY_UNIFORM,   /* 1 + 9*U(0,1), the classic model (default) */
+  DELAY_CONST,     /* fixed delay (param: the delay) */
+  DELAY_PARETO,    /* heavy-tailed: min * U^(-1/shape) (params: min, shape) */
+  DELAY_TRACE      /* delays read from a file, cycled */
+};
+
+static int delay_model = DELAY_UNIFORM;
+static float delay_p1 = 0.0;       /* constant value / Pareto minimum */
+static float delay_p2 = 0.0;       /* Pareto shape */
+static float *delay_trace = NULL;  /* -D trace:FILE samples */
+static int delay_trace_len = 0;
+
+/* parse -D: "uniform", "constant[:d]", "pareto[:min[,shape]]",
+   "trace:FILE" (one delay per line) */
+static void parse_delay_model(char *arg)
+{
+  char *colon = strchr(arg, ':');
+  char *param = NULL;
+
+  if (colon != NULL) {
+    *colon = '\0';
+    param = colon + 1;
+  }
+  if (strcmp(arg, "uniform") == 0) {
+    delay_model = DELAY_UNIFORM;
+  } else if (strcmp(arg, "constant") == 0) {
+    delay_model = DELAY_CONST;
+    delay_p1 = (param != NULL) ? (float)atof(param) : 5.5;   /* uniform mean */
+  } else if (strcmp(arg, "pareto") == 0) {
+    char *comma;
+
+    delay_model = DELAY_PARETO;
+    delay_p1 = 1.0;
+    delay_p2 = 2.5;
+    if (param != NULL) {
+      delay_p1 = (float)atof(param);
+      comma = strchr(param, ',');
+      if (comma != NULL)
+        delay_p2 = (float)atof(comma + 1);
+    }
+    if (delay_p2 <= 1.0) {
+      printf("pareto shape must be > 1 for a finite mean delay\n");
+      exit(EXIT_FAILURE);
+    }
+  } else if (strcmp(arg, "trace") == 0 && param != NULL) {
+    FILE *f = fopen(param, "r");
+    int cap = 1024;
+    float d;
+
+    if (f == NULL) {
+      printf("delay trace: cannot open %s\n", param);
+      exit(EXIT_FAILURE);
+    }
+    delay_model = DELAY_TRACE;
+    delay_trace = malloc(cap * sizeof(float));
+    delay_trace_len = 0;
+    while (delay_trace != NULL && fscanf(f, "%f", &d) == 1) {
+      if (delay_trace_len == cap) {
+        cap *= 2;
+        delay_trace = realloc(delay_trace, cap * sizeof(float));
+      }
+      if (delay_trace != NULL)
+        delay_trace[delay_trace_len++] = d;
+    }
+    fclose(f);
+    if (delay_trace == NULL) {
+      printf("memory allocation for delay trace failed.");
+      exit(EXIT_FAILURE);
+    }
+    if (delay_trace_len == 0) {
+      printf("delay trace: %s holds no samples\n", param);
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    printf("unknown delay model '%s' "
+           "(models: uniform constant pareto trace:FILE)\n", arg);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* draw one channel transit delay from the configured model */
+static float channel_delay(void)
+{
+  float u;
+
+  switch (delay_model) {
+    case DELAY_CONST:
+      return delay_p1;
+    case DELAY_PARETO:
+      u = 1.0f - (float)rng_uniform(RNG_DELAY);   /* (0,1]: keep pow finite */
+      return delay_p1 * powf(u, -1.0f / delay_p2);
+    case DELAY_TRACE:
+      u = delay_trace[delay_trace_pos];
+      delay_trace_pos = (delay_trace_pos + 1 == delay_trace_len)
+                            ? 0 : delay_trace_pos + 1;
+      return u;
+    default:
+      return 1 + 9*(float)rng_uniform(RNG_DELAY);
+  }
+}
+
+void tolayer3_pkt(int AorB, const struct pkt *packet)
+/* A or B is sending to network  */
+{
+  struct pkt *mypktptr;
+  struct event *evptr;
+  float lastime, start, x;
+  int ent;
+
+  /* AorB is the sender's role within its flow; direction checks below
+     stay role-based, entity arithmetic uses the flow's entity ids */
+  ent = flow_ent(AorB);
+  AorB = AorB & 1;
+  ntolayer3++;
+  flow_sent[ent >> 1]++;
+  if (replaying)
+    return;   /* the channel's fate for this packet is already in the trace */
+
+  /* simulate losses: */
+  if (rng_uniform(RNG_LOSS) < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    nlost++;
+    LOG(LOG_CHAN, 1, LOGC_L3_LOST, packet->seqnum, packet->acknum, 0);
+    return;
+  }
+
+  mypktptr = pkt_alloc();
+  *mypktptr = *packet;
+
+  /* create future event for arrival of packet at the other side */
+  evptr = event_alloc();
+  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
+  evptr->evkey = -1;
+  evptr->eventity = ent ^ 1;      /* event occurs at the flow's partner */
+  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
+  /* finally, compute the arrival time of packet at the other end.
+     medium can not reorder, so the packet arrives a model-drawn delay
+     after the latest arrival already scheduled for the destination;
+     that edge is tracked per destination in chan_lastime, so the
+     anchor costs one comparison instead of a scan of the event heap.
+     With -W, flows sending toward the same side first serialize on the
+     shared link: each packet holds it for 1/chan_bw. */
+  start = sim_time;
+  if (chan_bw > 0) {
+    int dir = evptr->eventity & 1;
+    if (chan_busy[dir] > start)
+      start = chan_busy[dir];
+    start += 1.0f / chan_bw;
+    chan_busy[dir] = start;
+  }
+  lastime = start;
+  if (chan_lastime[evptr->eventity] > lastime)
+    lastime = chan_lastime[evptr->eventity];
+  evptr->evtime = lastime + channel_delay();
+  chan_lastime[evptr->eventity] = evptr->evtime;
+
+
+  /* simulate corruption: */
+  if ((rng_uniform(RNG_CORRUPT) < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    ncorrupt++;
+    if ( (x = rng_uniform(RNG_CORRUPT)) < .75)
+      mypktptr->payload[0]='Z';   /* corrupt payload */
+    else if (x < .875)
+      mypktptr->seqnum = 999999;
+    else
+      mypktptr->acknum = 999999;
+    LOG(LOG_CHAN, 1, LOGC_L3_CORRUPT, mypktptr->seqnum, mypktptr->acknum, 0);
+  }
+
+  LOG(LOG_CHAN, 3, LOGC_L3_SEND, mypktptr->seqnum, mypktptr->acknum, evptr->evtime);
+  insertevent(evptr);
+}
+
+/* by-value compatibility wrapper */
+void tolayer3(int AorB, struct pkt packet)
+{
+  tolayer3_pkt(AorB, &packet);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  int i;  
+  if (TRACE>2) {
+    printf("          TOLAYER5: data received by application at ");
+    if (AorB == A) 
+      printf("A: ");
+    else
+      printf("B: ");
+    for (i=0; i<20; i++)  
+      printf("%c",datasent[i]);
+    printf("\n");
+  }
+  if (AorB == B && cur_flow == 0)
+    stats_msg_delivered(sim_time);
+  flow_delivered[cur_flow]++;
+  messages_delivered++;
+}
+
+/* batched delivery: the receiver hands a contiguous run of in-order
+   packets up in one call, paying the call and TRACE checks once per
+   run instead of once per packet */
+void tolayer5_batch(int AorB, struct pkt * const pkts[], int count)
+{
+  int i, k;
+
+  if (TRACE>2) {
+    for (k=0; k<count; k++) {
+      printf("          TOLAYER5: data received by application at ");
+      if (AorB == A)
+        printf("A: ");
+      else
+        printf("B: ");
+      for (i=0; i<20; i++)
+        printf("%c",pkts[k]->payload[i]);
+      printf("\n");
+    }
+  }
+  if (AorB == B && cur_flow == 0) {
+    for (k=0; k<count; k++)
+      stats_msg_delivered(sim_time);
+  }
+  flow_delivered[cur_flow] += count;
+  messages_delivered += count;
+}
+
+/* variable-length delivery: one reassembled application message,
+   handed up whole once its final segment arrived in order */
+void tolayer5_msg(int AorB, const char *data, int len)
+{
+  int i, n;
+
+  if (TRACE>2) {
+    printf("          TOLAYER5: %d-byte message received by application at ",
+           len);
+    if (AorB == A)
+      printf("A: ");
+    else
+      printf("B: ");
+    n = (len < 20) ? len : 20;
+    for (i=0; i<n; i++)
+      printf("%c",data[i]);
+    printf("\n");
+  }
+  if (AorB == B && cur_flow == 0)
+    stats_msg_delivered(sim_time);
+  flow_delivered[cur_flow]++;
+  messages_delivered++;
+}
+
+/* Checkpoint and restore.  A snapshot is one header of scalar run
+   state (clock, counters, RNG streams, channel parameters), the whole
+   pending-event set as trace_ev records, and the protocol state
+   appended by SR_checkpoint().  With -K the main loop writes one
+   atomically (temp file + rename) every -k events, and -X resumes a
+   run from the latest snapshot: a crash costs the events since the
+   last checkpoint instead of the whole run.  The -M statistics rings
+   are not snapshotted; after a restore they cover the resumed part
+   of the run only. */
+#define CKPT_MAGIC 0x53724b32   /* "SrK2" */
+
+struct ckpt_hdr {
+  unsigned int magic;
+  float sim_time;
+  float lossprob;
+  float corruptprob;
+  float lambda;
+  int corruptdirection;
+  int bidirectional;
+  int trace;
+  int nsim;
+  int nsimmax;
+  int msgsize_min;
+  int msgsize_max;
+  int arrivals_pending;
+  float arrival_horizon;
+  int nflows;             /* per-entity/per-flow arrays follow the header */
+  float chan_bw;
+  float chan_busy[2];
+  int delay_model;        /* -D model; trace samples follow the flow arrays */
+  float delay_p1;
+  float delay_p2;
+  int delay_trace_len;
+  int delay_trace_pos;
+  unsigned long long rng[RNG_NSTREAMS];
+  long events_processed;
+  int window_full;
+  int total_ACKs_received;
+  int packets_resent;
+  int new_ACKs;
+  int packets_received;
+  int messages_delivered;
+  int ntolayer3;
+  int nlost;
+  int ncorrupt;
+  int nevents;            /* trace_ev records that follow */
+};
+
+static const char *ckpt_path = NULL;   /* -K: where snapshots go */
+static long ckpt_interval = 1000000;   /* -k: events between snapshots */
+static __thread long ckpt_last = 0;    /* events_processed at the last snapshot */
+
+static void write_checkpoint(void)
+{
+  char tmppath[1024];
+  struct ckpt_hdr h;
+  struct trace_ev rec;
+  FILE *f;
+  int i;
+
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", ckpt_path);
+  f = fopen(tmppath, "wb");
+  if (f == NULL) {
+    printf("checkpoint: cannot open %s\n", tmppath);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&h, 0, sizeof(h));
+  h.magic = CKPT_MAGIC;
+  h.sim_time = sim_time;
+  h.lossprob = lossprob;
+  h.corruptprob = corruptprob;
+  h.lambda = lambda;
+  h.corruptdirection = corruptdirection;
+  h.bidirectional = bidirectional;
+  h.trace = TRACE;
+  h.nsim = nsim;
+  h.nsimmax = nsimmax;
+  h.msgsize_min = msgsize_min;
+  h.msgsize_max = msgsize_max;
+  h.arrivals_pending = arrivals_pending;
+  h.arrival_horizon = arrival_horizon;
+  h.nflows = nflows;
+  h.chan_bw = chan_bw;
+  h.chan_busy[A] = chan_busy[A];
+  h.chan_busy[B] = chan_busy[B];
+  h.delay_model = delay_model;
+  h.delay_p1 = delay_p1;
+  h.delay_p2 = delay_p2;
+  h.delay_trace_len = delay_trace_len;
+  h.delay_trace_pos = delay_trace_pos;
+  for (i = 0; i < RNG_NSTREAMS; i++)
+    h.rng[i] = rngstate[i];
+  h.events_processed = events_processed;
+  h.window_full = window_full;
+  h.total_ACKs_received = total_ACKs_received;
+  h.packets_resent = packets_resent;
+  h.new_ACKs = new_ACKs;
+  h.packets_received = packets_received;
+  h.messages_delivered = messages_delivered;
+  h.ntolayer3 = ntolayer3;
+  h.nlost = nlost;
+  h.ncorrupt = ncorrupt;
+  h.nevents = evheap_len;
+  fwrite(&h, sizeof(h), 1, f);
+
+  /* per-entity channel edges and per-flow counters, sized by nflows */
+  fwrite(chan_lastime, sizeof(float), 2*nflows, f);
+  fwrite(flow_sent, sizeof(int), nflows, f);
+  fwrite(flow_delivered, sizeof(int), nflows, f);
+
+  /* -D trace samples travel with the snapshot, so a resume needs
+     neither the command line nor the original trace file */
+  if (delay_model == DELAY_TRACE)
+    fwrite(delay_trace, sizeof(float), delay_trace_len, f);
+
+  /* heap array order; restore re-inserts, so order is irrelevant */
+  for (i = 0; i < evheap_len; i++) {
+    rec.evtime = evheap[i]->evtime;
+    rec.evtype = evheap[i]->evtype;
+    rec.eventity = evheap[i]->eventity;
+    rec.evkey = evheap[i]->evkey;
+    if (evheap[i]->evtype == FROM_LAYER3)
+      rec.pkt = *evheap[i]->pktptr;
+    else
+      memset(&rec.pkt, 0, sizeof(rec.pkt));
+    fwrite(&rec, sizeof(rec), 1, f);
+  }
+
+  SR_checkpoint(f);
+
+  if (fclose(f) != 0 || rename(tmppath, ckpt_path) != 0) {
+    printf("checkpoint: cannot write %s\n", ckpt_path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void restore_checkpoint(const char *path)
+{
+  struct ckpt_hdr h;
+  struct trace_ev rec;
+  struct event *evptr;
+  FILE *f;
+  int i;
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    printf("restore: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != CKPT_MAGIC) {
+    printf("restore: %s is not a checkpoint file\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  sim_time = h.sim_time;
+  lossprob = h.lossprob;
+  corruptprob = h.corruptprob;
+  lambda = h.lambda;
+  corruptdirection = h.corruptdirection;
+  bidirectional = h.bidirectional;
+  TRACE = h.trace;
+  nsim = h.nsim;
+  nsimmax = h.nsimmax;
+  msgsize_min = h.msgsize_min;
+  msgsize_max = h.msgsize_max;
+  arrivals_pending = h.arrivals_pending;
+  arrival_horizon = h.arrival_horizon;
+  nflows = h.nflows;
+  SR_set_nflows(nflows);
+  engine_alloc();
+  chan_bw = h.chan_bw;
+  chan_busy[A] = h.chan_busy[A];
+  chan_busy[B] = h.chan_busy[B];
+  delay_model = h.delay_model;
+  delay_p1 = h.delay_p1;
+  delay_p2 = h.delay_p2;
+  delay_trace_pos = h.delay_trace_pos;
+  for (i = 0; i < RNG_NSTREAMS; i++)
+    rngstate[i] = h.rng[i];
+  events_processed = h.events_processed;
+  window_full = h.window_full;
+  total_ACKs_received = h.total_ACKs_received;
+  packets_resent = h.packets_resent;
+  new_ACKs = h.new_ACKs;
+  packets_received = h.packets_received;
+  messages_delivered = h.messages_delivered;
+  ntolayer3 = h.ntolayer3;
+  nlost = h.nlost;
+  ncorrupt = h.ncorrupt;
+  ckpt_last = events_processed;
+  stats_reset();   /* -M statistics cover the resumed part only */
+
+  if (fread(chan_lastime, sizeof(float), 2*nflows, f) != (size_t)(2*nflows) ||
+      fread(flow_sent, sizeof(int), nflows, f) != (size_t)nflows ||
+      fread(flow_delivered, sizeof(int), nflows, f) != (size_t)nflows) {
+    printf("restore: %s is truncated\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  if (delay_model == DELAY_TRACE) {
+    if (h.delay_trace_len <= 0) {
+      printf("restore: %s holds no delay trace samples\n", path);
+      exit(EXIT_FAILURE);
+    }
+    free(delay_trace);
+    delay_trace = malloc(h.delay_trace_len * sizeof(float));
+    if (delay_trace == NULL) {
+      printf("memory allocation for delay trace failed.");
+      exit(EXIT_FAILURE);
+    }
+    if (fread(delay_trace, sizeof(float), h.delay_trace_len, f)
+        != (size_t)h.delay_trace_len) {
+      printf("restore: %s is truncated\n", path);
+      exit(EXIT_FAILURE);
+    }
+    delay_trace_len = h.delay_trace_len;
+  }
+
+  for (i = 0; i < h.nevents; i++) {
+    if (fread(&rec, sizeof(rec), 1, f) != 1) {
+      printf("restore: %s is truncated\n", path);
+      exit(EXIT_FAILURE);
+    }
+    evptr = event_alloc();
+    evptr->evtime = rec.evtime;
+    evptr->evtype = rec.evtype;
+    evptr->eventity = rec.eventity;
+    evptr->evkey = rec.evkey;
+    if (rec.evtype == FROM_LAYER3) {
+      evptr->pktptr = pkt_alloc();
+      *evptr->pktptr = rec.pkt;
+    } else {
+      evptr->pktptr = NULL;
+    }
+    insertevent(evptr);   /* re-registers the legacy per-entity timer */
+    if (rec.evtype == TIMER_INTERRUPT && rec.evkey >= 0) {
+      keyed_timer_reserve(rec.eventity, rec.evkey);
+      keyed_timer[rec.eventity][rec.evkey] = evptr;
+    }
+  }
+
+  SR_restore(f);
+  fclose(f);
+}
+
+/* dispatch one popped event to the right entity; the caller has already
+   advanced sim_time and will recycle the event afterwards */
+static void dispatch_event(struct event *eventptr)
+{
+  struct msg  msg2give;
+
+  int i,j;
+  int role;
+
+  events_processed++;
+  /* the event's entity selects which flow's protocol instance runs;
+     handlers are then called by role, as always */
+  cur_flow = eventptr->eventity >> 1;
+  role = eventptr->eventity & 1;
+  SR_select_flow(cur_flow);
+  if (capture_file != NULL) {
+    struct trace_ev rec;
+    rec.evtime = eventptr->evtime;
+    rec.evtype = eventptr->evtype;
+    rec.eventity = eventptr->eventity;
+    rec.evkey = eventptr->evkey;
+    if (eventptr->evtype == FROM_LAYER3)
+      rec.pkt = *eventptr->pktptr;
+    else
+      memset(&rec.pkt, 0, sizeof(rec.pkt));
+    fwrite(&rec, sizeof(rec), 1, capture_file);
+  }
+  if (TRACE>=2) {
+    printf("\nEVENT time: %f,",eventptr->evtime);
+    printf("  type: %d",eventptr->evtype);
+    if (eventptr->evtype==0)
+      printf(", timerinterrupt  ");
+    else if (eventptr->evtype==1)
+      printf(", fromlayer5 ");
+    else
+      printf(", fromlayer3 ");
+    printf(" entity: %d\n",eventptr->eventity);
+  }
+  if (eventptr->evtype == FROM_LAYER5 ) {
+    arrivals_pending--;
+    if (nsim < nsimmax) {
+      generate_next_arrival();   /* set up future arrival */
+      j = nsim % 26;
+      if (msgsize_max > 0) {
+        /* variable-length workload: draw a size and hand the message
+           to the segmentation layer above A_output() */
+        static __thread char msgbuf[MSG_MAXLEN];
+        int len = msgsize_min
+                  + (int)(rng_uniform(RNG_MSGSIZE)
+                          * (msgsize_max - msgsize_min + 1));
+        if (len > msgsize_max)
+          len = msgsize_max;
+        memset(msgbuf, 97 + j, len);
+        if (TRACE>2)
+          printf("          MAINLOOP: %d-byte message given to student: %c...\n",
+                 len, msgbuf[0]);
+        nsim++;
+        if (role == A) {
+          /* stamp the A-to-B latency clock as the message leaves layer 5
+             (flow 0 only: the -M latency series tracks one flow) */
+          if (eventptr->eventity == A)
+            stats_msg_sent(sim_time);
+          A_output_data(msgbuf, len);
+        }
+        else
+          B_output_data(msgbuf, len);
+        return;
+      }
+      /* fill in msg to give with string of same letter */
+      for (i=0; i<20; i++)
+        msg2give.data[i] = 97 + j;
+      msg2give.length = 20;
+      msg2give.eom = 1;
+      if (TRACE>2) {
+        printf("          MAINLOOP: data given to student: ");
+        for (i=0; i<20; i++)
+          printf("%c", msg2give.data[i]);
+        printf("\n");
+      }
+      nsim++;
+      if (role == A) {
+        /* stamp the A-to-B latency clock as the message leaves layer 5
+           (flow 0 only: the -M latency series tracks one flow) */
+        if (eventptr->eventity == A)
+          stats_msg_sent(sim_time);
+        A_output(msg2give);
+      }
+      else
+        B_output(msg2give);
+    }
+    else if (TRACE > 2)
+        printf("          FROM_LAYER5: no more messages to send: \n");
+  }
+  else if (eventptr->evtype ==  FROM_LAYER3) {
+    /* zero-copy delivery: hand the channel's packet straight to the
+       entity, which takes ownership (stores it or recycles it) */
+	    if (role == A)                   /* deliver packet by calling */
+      A_input_pkt(eventptr->pktptr); /* appropriate entity */
+    else
+      B_input_pkt(eventptr->pktptr);
+  }
+  else if (eventptr->evtype ==  TIMER_INTERRUPT) {
+    if (eventptr->evkey >= 0) {      /* per-packet timer */
+      if (role == A)
+        A_packettimeout(eventptr->evkey);
+      else
+        B_packettimeout(eventptr->evkey);
+    }
+    else if (role == A)
+      A_timerinterrupt();
+    else
+      B_timerinterrupt();
+  }
+  else  {
+    printf("INTERNAL PANIC: unknown event type \n");
+  }
+}
+
+/* events popped per batch; ties beyond this just start another batch */
+#define DEQUEUE_BATCH 16
+
+/* run the event loop until the pending-event set drains.  Events
+   sharing the current timestamp (simultaneous timer fires, back-to-back
+   channel deliveries) are popped together, so the clock is advanced and
+   the heap settled once per timestamp before any protocol code runs. */
+static void run_loop(void)
+{
+  struct event *batch[DEQUEUE_BATCH];
+  int n, i;
+
+  while (1) {
+    /* snapshot between events, where the state is consistent */
+    if (ckpt_path != NULL && events_processed - ckpt_last >= ckpt_interval) {
+      write_checkpoint();
+      ckpt_last = events_processed;
+    }
+    batch[0] = evheap_pop();      /* get next event to simulate */
+    if (batch[0]==NULL)
+      return;
+    n = 1;
+    while (n < DEQUEUE_BATCH && evheap_len > 0 &&
+           evheap[0]->evtime == batch[0]->evtime)
+      batch[n++] = evheap_pop();
+    sim_time = batch[0]->evtime;    /* update time to next event time */
+    for (i = 0; i < n; i++) {
+      dispatch_event(batch[i]);
+      event_free(batch[i]);
+    }
+  }
+}
+
+/* replay a captured event trace: each record is dispatched exactly as
+   the main loop would have, but the RNG never advances, nothing is
+   scheduled and nothing transits the channel - inbound packets and
+   timer fires are read off the trace.  maxevents > 0 stops after that
+   many events, for bisecting where a run goes wrong. */
+static void run_replay(const char *path, long maxevents)
+{
+  FILE *f;
+  struct trace_ev rec;
+  struct msg msg2give;
+  struct pkt *pkt2give;
+  long nevents = 0;
+  int i, j;
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    printf("replay: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  replaying = 1;
+  while (fread(&rec, sizeof(rec), 1, f) == 1) {
+    if (maxevents > 0 && nevents >= maxevents)
+      break;
+    nevents++;
+    sim_time = rec.evtime;
+    cur_flow = rec.eventity >> 1;
+    SR_select_flow(cur_flow);
+    if (rec.evtype == FROM_LAYER5) {
+      if (nsim < nsimmax) {
+        /* regenerate the message the original run handed down; replay
+           always uses the classic fixed 20-byte workload (-m is a live
+           RNG consumer and is ignored here) */
+        j = nsim % 26;
+        for (i=0; i<20; i++)
+          msg2give.data[i] = 97 + j;
+        msg2give.length = 20;
+        msg2give.eom = 1;
+        nsim++;
+        if ((rec.eventity & 1) == A)
+          A_output(msg2give);
+        else
+          B_output(msg2give);
+      }
+    }
+    else if (rec.evtype == FROM_LAYER3) {
+      pkt2give = pkt_alloc();
+      *pkt2give = rec.pkt;
+      if ((rec.eventity & 1) == A)
+        A_input_pkt(pkt2give);
+      else
+        B_input_pkt(pkt2give);
+    }
+    else if (rec.evtype == TIMER_INTERRUPT) {
+      if (rec.evkey >= 0) {
+        if ((rec.eventity & 1) == A)
+          A_packettimeout(rec.evkey);
+        else
+          B_packettimeout(rec.evkey);
+      }
+      else if ((rec.eventity & 1) == A)
+        A_timerinterrupt();
+      else
+        B_timerinterrupt();
+    }
+  }
+  replaying = 0;
+  fclose(f);
+  printf("# replayed %ld events from %s\n", nevents, path);
+}
+
+/* initialise every flow's protocol instance for a fresh run */
+static void init_flows(void)
+{
+  int f;
+
+  for (f = 0; f < nflows; f++) {
+    cur_flow = f;
+    SR_select_flow(f);
+    A_init();
+    B_init();
+  }
+  cur_flow = 0;
+  SR_select_flow(0);
+}
+
+static void print_report(void)
+{
+  int f;
+
+  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",sim_time,nsim);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
+  printf("number of packet resends by A:  %d \n", packets_resent);
+  printf("number of correct packets received at B:  %d \n", packets_received);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (nflows > 1) {
+    for (f = 0; f < nflows; f++)
+      printf("flow %d: %d packets into layer 3, %d messages delivered\n",
+             f, flow_sent[f], flow_delivered[f]);
+  }
+}
+
+/***************** batch mode and sweep driver *********************/
+/* With no arguments the simulator prompts interactively, exactly as
+   before.  With arguments it runs unattended:
+
+     -n N      messages to simulate
+     -l LIST   loss probability (comma-separated list sweeps)
+     -c LIST   corruption probability (comma-separated list sweeps)
+     -d DIR    loss/corruption direction: 0 A->B, 1 A<-B, 2 both
+     -g LIST   lambda, mean gap between layer5 messages (list sweeps)
+     -w LIST   send window size (list sweeps)
+     -q N      sequence space (0 = 2 x window)
+     -m MIN,MAX  variable message sizes: each layer 5 message draws a
+               uniform size in [MIN, MAX] bytes (a single value fixes
+               the size) and is segmented into 20-byte packets;
+               ignored under -P, which replays the fixed workload
+     -s SEED   RNG seed
+     -D MODEL  channel delay model: uniform (1..10, as shipped),
+               constant[:d], pareto[:min[,shape]] for heavy tails, or
+               trace:FILE with one delay per line, cycled.  FIFO
+               delivery is preserved under every model.
+     -F N      concurrent flows: N independent SR connections share
+               the channel; arrivals spread across flows uniformly and
+               the report gains per-flow sent/delivered counts.  The
+               -M latency series tracks flow 0.  Not with -b.
+     -W RATE   shared link bandwidth in packets per time unit: flows
+               sending toward the same side serialize, each packet
+               holding the link for 1/RATE (0 = unlimited)
+     -T N      TRACE level
+     -B FILE   write binary trace records to FILE (see log.h)
+     -C FILE   capture every main-loop event to FILE for replay
+     -P FILE   replay a captured event trace (pass the same -n/-w/-q/-S
+               as the capture run; -l/-c/-g and the RNG are not used)
+     -e N      replay only the first N events (bisection)
+     -M PREFIX record latency/occupancy/retransmit statistics and write
+               PREFIX_latency.csv, PREFIX_window.csv, PREFIX_retx.csv
+               (covers the last cell when sweeping)
+     -O FILE   stream one fixed-stride binary record per run into FILE
+               for mmap consumption: header with schema and offsets,
+               then the record array (see results.h).  Counters are
+               always filled; the latency histogram fields need -M.
+               Covers batch runs and sweeps, one record per cell
+     -Y N      run the hot-path microbenchmarks (checksum kernels,
+               window predicate, base-advance scan, insertevent at
+               several queue depths) for N iterations per case and
+               exit; 0 uses the default count
+     -K FILE   write a binary checkpoint to FILE periodically
+     -k N      events between checkpoints (default one million)
+     -X FILE   resume from the checkpoint in FILE (configuration is
+               read from the snapshot; combine with -K to keep
+               checkpointing)
+
+   If any of -l/-c/-g/-w has more than one value the driver runs the
+   full cartesian grid in one process, reusing pools and window
+   allocations between cells, and emits one CSV row per cell on stdout
+   instead of the interactive report. */
+
+#define SWEEP_MAX 256   /* max values per swept parameter */
+
+static int parse_float_list(const char *s, float *out, int max)
+{
+  int n = 0;
+  char *end;
+
+  while (*s != '\0' && n < max) {
+    out[n++] = (float)strtod(s, &end);
+    if (end == s)
+      break;
+    s = (*end == ',') ? end + 1 : end;
+  }
+  return n;
+}
+
+static int parse_int_list(const char *s, int *out, int max)
+{
+  int n = 0;
+  char *end;
+
+  while (*s != '\0' && n < max) {
+    out[n++] = (int)strtol(s, &end, 10);
+    if (end == s)
+      break;
+    s = (*end == ',') ? end + 1 : end;
+  }
+  return n;
+}
+
+/* Microbenchmarks (-Y): drive the hot-path primitives in isolation -
+   the checksum kernels, the window-membership predicate, the packed
+   base-advance scan and insertevent() at several queue depths - and
+   report the cost per operation from a cycle counter where the ISA
+   exposes one (TSC on x86-64, the generic counter on aarch64), falling
+   back to clock_gettime() nanoseconds elsewhere. */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CYCLE_UNIT "rdtsc cycles"
+static unsigned long long cycles_now(void)
+{
+  unsigned int lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((unsigned long long)hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+#define CYCLE_UNIT "cntvct ticks"
+static unsigned long long cycles_now(void)
+{
+  unsigned long long v;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+}
+#else
+#define CYCLE_UNIT "ns"
+static unsigned long long cycles_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/* one report row: cost of iters operations measured as t1 - t0 */
+static void bench_row(const char *name, long iters, unsigned long long dt)
+{
+  printf("%-28s %10.2f %s/op\n", name, (double)dt / (double)iters, CYCLE_UNIT);
+}
+
+/* insertevent() plus a remove of the heap root, at a steady depth */
+static long bench_insertevent(int depth, long iters)
+{
+  struct event *evptr;
+  unsigned long long t0, t1;
+  char name[64];
+  long acc = 0;
+  long i;
+
+  for (i = 0; i < depth; i++) {
+    evptr = event_alloc();
+    evptr->evtime = (float)(rng_uniform(RNG_MISC) * 1e6);
+    evptr->evtype = FROM_LAYER5;
+    evptr->eventity = A;
+    evptr->evkey = -1;
+    evptr->pktptr = NULL;
+    insertevent(evptr);
+  }
+
+  t0 = cycles_now();
+  for (i = 0; i < iters; i++) {
+    evptr = event_alloc();
+    evptr->evtime = (float)(rng_uniform(RNG_MISC) * 1e6);
+    evptr->evtype = FROM_LAYER5;
+    evptr->eventity = A;
+    evptr->evkey = -1;
+    evptr->pktptr = NULL;
+    insertevent(evptr);
+    evptr = evheap[0];           /* remove-min keeps the depth steady */
+    acc += (long)evptr->evtime;
+    evheap_remove(evptr);
+    event_free(evptr);
+  }
+  t1 = cycles_now();
+
+  while (evheap_len > 0) {
+    evptr = evheap[0];
+    evheap_remove(evptr);
+    event_free(evptr);
+  }
+
+  snprintf(name, sizeof(name), "insertevent depth=%d", depth);
+  bench_row(name, iters, t1 - t0);
+  return acc;
+}
+
+static void run_microbench(long iters)
+{
+  static const int wlist[] = { 8, 64, 1024 };
+  static const int dlist[] = { 16, 256, 4096, 65536 };
+  struct pkt p;
+  unsigned long long t0, t1;
+  char name[64];
+  long acc = 0;
+  long i;
+  int k;
+
+  if (iters <= 0)
+    iters = 5000000;
+  engine_alloc();
+  printf("# microbenchmarks: %ld iters/case, counter: %s\n",
+         iters, CYCLE_UNIT);
+
+  /* checksum kernels; the mutated header keeps loads in the loop */
+  memset(&p, 0, sizeof(p));
+  memcpy(p.payload, "abcdefghijklmnopqrst", 20);
+  p.length = 20;
+  p.eom = 1;
+  t0 = cycles_now();
+  for (i = 0; i < iters; i++) {
+    p.seqnum = (int)i;
+    acc += ComputeChecksum(p);
+  }
+  t1 = cycles_now();
+  bench_row("ComputeChecksum", iters, t1 - t0);
+
+  t0 = cycles_now();
+  for (i = 0; i < iters; i++) {
+    p.payload[0] = (char)i;
+    acc += PayloadDigest(p.payload);
+  }
+  t1 = cycles_now();
+  bench_row("PayloadDigest", iters, t1 - t0);
+
+  /* window-membership predicate across window sizes (wraparound
+     included: the driver slides the base through the sequence space) */
+  for (k = 0; k < (int)(sizeof(wlist)/sizeof(wlist[0])); k++) {
+    t0 = cycles_now();
+    acc += SR_bench_window(wlist[k], 2*wlist[k], iters);
+    t1 = cycles_now();
+    snprintf(name, sizeof(name), "in_window w=%d q=%d",
+             wlist[k], 2*wlist[k]);
+    bench_row(name, iters, t1 - t0);
+  }
+
+  /* base-advance scan: one op releases a full window minus one slot */
+  for (k = 0; k < (int)(sizeof(wlist)/sizeof(wlist[0])); k++) {
+    long adv_iters = iters / 8;
+    t0 = cycles_now();
+    acc += SR_bench_advance(wlist[k], adv_iters);
+    t1 = cycles_now();
+    snprintf(name, sizeof(name), "advance_send_base w=%d", wlist[k]);
+    bench_row(name, adv_iters, t1 - t0);
+  }
+
+  /* scheduler insert+remove-min across queue depths */
+  for (k = 0; k < (int)(sizeof(dlist)/sizeof(dlist[0])); k++)
+    acc += bench_insertevent(dlist[k], iters / 4);
+
+  printf("# accumulator %ld\n", acc);   /* defeats dead-code elimination */
+}
+
+static void usage(const char *prog)
+{
+  printf("usage: %s [-n msgs] [-l loss[,loss...]] [-c corrupt[,corrupt...]]\n"
+         "          [-d direction] [-g lambda[,lambda...]] [-w window[,window...]]\n"
+         "          [-q seqspace] [-s seed] [-r stream=seed (pin one RNG\n"
+         "           stream: arrivals, loss, corruption, delay, msgsize, misc)]\n"
+         "          [-m min,max (variable message sizes in bytes, segmented\n"
+         "           across window slots; max %d)]\n"
+         "          [-D model (channel delay: uniform, constant[:d],\n"
+         "           pareto[:min[,shape]], trace:FILE)]\n"
+         "          [-F flows (concurrent sender/receiver pairs sharing the\n"
+         "           channel)] [-W rate (shared link bandwidth, packets/unit)]\n"
+         "          [-T trace] [-B tracefile]\n"
+         "          [-C capturefile] [-P replayfile] [-e maxevents]\n"
+         "          [-K checkpointfile] [-k ckpt-interval] [-X restorefile]\n"
+         "          [-M statsprefix] [-O resultsfile (binary run records)]\n"
+         "          [-Y iters (primitive microbenchmarks; 0 = default count)]\n"
+         "          [-R replications] [-j threads] [-S (SACK mode)]\n"
+         "          [-A (congestion control: slow start / AIMD / fast recovery)]\n"
+         "          [-u (cumulative-ACK hybrid: ACKs carry the in-order edge)]\n"
+         "          [-N (NAK mode: ACKs carry a bitmap of receive-window holes)]\n"
+         "          [-b (bidirectional: data both ways, piggybacked ACKs)]\n"
+         "run with no arguments for interactive mode\n", prog, MSG_MAXLEN);
+  exit(EXIT_FAILURE);
+}
+
+/* run one cell of the grid and emit its CSV row */
+static void run_cell(float loss, float corrupt, float lam, int window,
+                     int seqspacearg, int csv)
+{
+  struct timespec t0, t1;
+  double wall;
+  long nevents;
+
+  lossprob = loss;
+  corruptprob = corrupt;
+  lambda = lam;
+  SR_configure(window, seqspacearg);
+  sim_srand(rngseed);
+  reset_run();
+  init_flows();
+  nevents = events_processed;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  run_loop();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  nevents = events_processed - nevents;
+  wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+  if (res_recording()) {
+    struct res_rec r;
+
+    memset(&r, 0, sizeof(r));
+    r.lossprob = lossprob;
+    r.corruptprob = corruptprob;
+    r.lambda = lambda;
+    r.window = window;
+    r.seqspace = seqspacearg;
+    r.nflows = nflows;
+    r.nsimmax = nsimmax;
+    r.nsim = nsim;
+    r.window_full = window_full;
+    r.new_ACKs = new_ACKs;
+    r.packets_resent = packets_resent;
+    r.packets_received = packets_received;
+    r.messages_delivered = messages_delivered;
+    r.ntolayer3 = ntolayer3;
+    r.nlost = nlost;
+    r.ncorrupt = ncorrupt;
+    r.sim_time = sim_time;
+    r.wall = wall;
+    r.events = nevents;
+    stats_latency_snapshot(&r.lat_count, &r.lat_sum, &r.lat_max, r.lat_mag);
+    res_emit(&r);
+  }
+  if (csv)
+    printf("%g,%g,%g,%d,%d,%d,%d,%d,%d,%d,%d,%f,%ld,%.0f\n",
+           lossprob, corruptprob, lambda, window, nsimmax, nsim,
+           window_full, new_ACKs, packets_resent, packets_received,
+           messages_delivered, sim_time, nevents,
+           (wall > 0.0) ? nevents/wall : 0.0);
+  else
+    print_report();
+}
+
+/***************** threaded replication engine *********************/
+/* Because every piece of per-run state (emulator globals, SR window
+   state, RNG stream) is thread-local, a worker thread is a complete
+   independent simulation instance.  Workers claim replication indices
+   from a shared counter with an atomic fetch-and-add and write results
+   into their own slot of a preallocated array, so no locks are taken
+   anywhere on the simulation path or during aggregation. */
+
+struct rep_result {
+  int nsim;
+  int window_full;
+  int new_ACKs;
+  int packets_resent;
+  int packets_received;
+  int messages_delivered;
+  float endtime;
+};
+
+static struct {                 /* read-only while workers run */
+  int nsimmax;
+  float lossprob, corruptprob;
+  int corruptdirection;
+  float lambda;
+  int window, seqspace;
+  int seed;
+  int nreps;
+  struct rep_result *results;
+  int next;                     /* work index, claimed atomically */
+} repcfg;
+
+static void *rep_worker(void *arg)
+{
+  struct rep_result *res;
+  int r;
+
+  (void)arg;
+  for (;;) {
+    r = __sync_fetch_and_add(&repcfg.next, 1);
+    if (r >= repcfg.nreps)
+      break;
+
+    nsimmax = repcfg.nsimmax;
+    lossprob = repcfg.lossprob;
+    corruptprob = repcfg.corruptprob;
+    corruptdirection = repcfg.corruptdirection;
+    lambda = repcfg.lambda;
+    SR_configure(repcfg.window, repcfg.seqspace);
+    sim_srand(repcfg.seed + r);   /* one seed per replication, not per thread */
+    reset_run();
+    init_flows();
+    run_loop();
+
+    res = &repcfg.results[r];
+    res->nsim = nsim;
+    res->window_full = window_full;
+    res->new_ACKs = new_ACKs;
+    res->packets_resent = packets_resent;
+    res->packets_received = packets_received;
+    res->messages_delivered = messages_delivered;
+    res->endtime = sim_time;
+  }
+  log_flush();   /* this thread's ring dies with the thread */
+  return NULL;
+}
+
+static void run_replications(int nreps, int nthreads)
+{
+  pthread_t *threads;
+  double sum_resent = 0, sum_delivered = 0, sum_acks = 0, sum_full = 0;
+  double sum_time = 0;
+  int t;
+  int r;
+
+  if (nthreads < 1) {
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+      nthreads = 1;
+  }
+  if (nthreads > nreps)
+    nthreads = nreps;
+
+  repcfg.nreps = nreps;
+  repcfg.next = 0;
+  repcfg.results = malloc(nreps * sizeof(struct rep_result));
+  threads = malloc(nthreads * sizeof(pthread_t));
+  if (repcfg.results == NULL || threads == NULL) {
+    printf("memory allocation for replication engine failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  for (t = 0; t < nthreads; t++)
+    if (pthread_create(&threads[t], NULL, rep_worker, NULL) != 0) {
+      printf("failed to create replication worker thread.");
+      exit(EXIT_FAILURE);
+    }
+  for (t = 0; t < nthreads; t++)
+    pthread_join(threads[t], NULL);
+
+  printf("replication,lossprob,corruptprob,lambda,windowsize,msgs_sent,"
+         "window_full,new_ACKs,packets_resent,packets_received,"
+         "messages_delivered,sim_time\n");
+  for (r = 0; r < nreps; r++) {
+    struct rep_result *res = &repcfg.results[r];
+    printf("%d,%g,%g,%g,%d,%d,%d,%d,%d,%d,%d,%f\n",
+           r, repcfg.lossprob, repcfg.corruptprob, repcfg.lambda,
+           repcfg.window, res->nsim, res->window_full, res->new_ACKs,
+           res->packets_resent, res->packets_received,
+           res->messages_delivered, res->endtime);
+    sum_full += res->window_full;
+    sum_acks += res->new_ACKs;
+    sum_resent += res->packets_resent;
+    sum_delivered += res->messages_delivered;
+    sum_time += res->endtime;
+  }
+  printf("# %d replications on %d threads: mean window_full %.2f, "
+         "mean new_ACKs %.2f, mean resent %.2f, mean delivered %.2f, "
+         "mean sim_time %.2f\n",
+         nreps, nthreads, sum_full/nreps, sum_acks/nreps,
+         sum_resent/nreps, sum_delivered/nreps, sum_time/nreps);
+
+  free(threads);
+  free(repcfg.results);
+}
+
+int main(int argc, char *argv[])
+{
+  float lossv[SWEEP_MAX], corruptv[SWEEP_MAX], lambdav[SWEEP_MAX];
+  int windowv[SWEEP_MAX];
+  int nloss = 0, ncorr = 0, nlambda = 0, nwindow = 0;
+  int seqspacearg = 0;
+  int nreps = 0, nthreads = 0;
+  int binlog = 0;
+  const char *replayfile = NULL;
+  const char *restorefile = NULL;
+  long microiters = -1;
+  int micro = 0;
+  int sack = 0, nak = 0;
+  const char *statsprefix = NULL;
+  long maxevents = 0;
+  int csv;
+  int i, j, k, m;
+
+  if (argc == 1) {
+    /* interactive mode, as shipped */
+    init();
+    init_flows();
+    run_loop();
+    print_report();
+    return EXIT_SUCCESS;
+  }
+
+  /* batch mode defaults */
+  nsimmax = 1000;
+  lossv[0] = 0.0;     nloss = 1;
+  corruptv[0] = 0.0;  ncorr = 1;
+  lambdav[0] = 50.0;  nlambda = 1;
+  windowv[0] = 0;     nwindow = 1;
+  corruptdirection = 2;
+  TRACE = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (argv[i][0] != '-' || argv[i][1] == '\0')
+      usage(argv[0]);
+    /* every flag except the boolean ones takes a value */
+    if (strchr("SAbuN", argv[i][1]) == NULL && i+1 >= argc)
+      usage(argv[0]);
+    switch (argv[i][1]) {
+      case 'n': nsimmax = atoi(argv[++i]); break;
+      case 'l': nloss = parse_float_list(argv[++i], lossv, SWEEP_MAX); break;
+      case 'c': ncorr = parse_float_list(argv[++i], corruptv, SWEEP_MAX); break;
+      case 'd': corruptdirection = atoi(argv[++i]); break;
+      case 'g': nlambda = parse_float_list(argv[++i], lambdav, SWEEP_MAX); break;
+      case 'w': nwindow = parse_int_list(argv[++i], windowv, SWEEP_MAX); break;
+      case 'q': seqspacearg = atoi(argv[++i]); break;
+      case 'm': {   /* variable message sizes: -m min,max or -m len */
+        char *arg = argv[++i];
+        char *comma = strchr(arg, ',');
+
+        msgsize_min = atoi(arg);
+        msgsize_max = (comma != NULL) ? atoi(comma + 1) : msgsize_min;
+        if (msgsize_min < 1 || msgsize_max < msgsize_min ||
+            msgsize_max > MSG_MAXLEN) {
+          printf("message sizes must satisfy 1 <= min <= max <= %d\n",
+                 MSG_MAXLEN);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 's': rngseed = atoi(argv[++i]); break;
+      case 'r': {   /* pin one stream's seed: -r loss=1234 */
+        char *arg = argv[++i];
+        char *eq = strchr(arg, '=');
+        int st;
+
+        if (eq == NULL)
+          usage(argv[0]);
+        *eq = '\0';
+        for (st = 0; st < RNG_NSTREAMS; st++)
+          if (strcmp(arg, rng_stream_name[st]) == 0)
+            break;
+        if (st == RNG_NSTREAMS) {
+          printf("unknown RNG stream '%s' (streams:", arg);
+          for (st = 0; st < RNG_NSTREAMS; st++)
+            printf(" %s", rng_stream_name[st]);
+          printf(")\n");
+          exit(EXIT_FAILURE);
+        }
+        rng_pinned[st] = atoll(eq + 1);
+        break;
+      }
+      case 'T': TRACE = atoi(argv[++i]); break;
+      case 'B': log_open(argv[++i]); binlog = 1; break;
+      case 'C':
+        capture_file = fopen(argv[++i], "wb");
+        if (capture_file == NULL) {
+          printf("capture: cannot open %s\n", argv[i]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'P': replayfile = argv[++i]; break;
+      case 'D': parse_delay_model(argv[++i]); break;
+      case 'F': nflows = atoi(argv[++i]); break;
+      case 'W': chan_bw = (float)atof(argv[++i]); break;
+      case 'K': ckpt_path = argv[++i]; break;
+      case 'k': ckpt_interval = atol(argv[++i]); break;
+      case 'X': restorefile = argv[++i]; break;
+      case 'e': maxevents = atol(argv[++i]); break;
+      case 'M': statsprefix = argv[++i]; stats_enabled = 1; break;
+      case 'O': res_open(argv[++i]); break;
+      case 'Y': microiters = atol(argv[++i]); micro = 1; break;
+      case 'R': nreps = atoi(argv[++i]); break;
+      case 'j': nthreads = atoi(argv[++i]); break;
+      case 'S': SR_enable_sack(1); sack = 1; break;
+      case 'A': SR_enable_cc(1); break;
+      case 'u': SR_enable_cumack(1); break;
+      case 'N': SR_enable_nak(1); nak = 1; break;
+      case 'b': bidirectional = 1; break;
+      default:  usage(argv[0]);
+    }
+  }
+  if (nflows < 1) {
+    printf("flow count must be at least 1\n");
+    exit(EXIT_FAILURE);
+  }
+  if (nflows > 1 && bidirectional) {
+    printf("multi-flow (-F) and bidirectional (-b) cannot be combined\n");
+    exit(EXIT_FAILURE);
+  }
+  if (capture_file != NULL && nreps > 0) {
+    /* the capture stream is one shared file; concurrent replications
+       would interleave their records into an unreplayable trace */
+    printf("capture (-C) and replications (-R) cannot be combined\n");
+    exit(EXIT_FAILURE);
+  }
+  if (sack && nak) {
+    /* both encode the ACK payload as a window bitmap, with opposite
+       meanings (held packets vs holes); a sender given one would read
+       the other as resend requests for delivered packets */
+    printf("SACK (-S) and NAK (-N) cannot be combined\n");
+    exit(EXIT_FAILURE);
+  }
+  SR_set_nflows(nflows);
+  if (nloss < 1 || ncorr < 1 || nlambda < 1 || nwindow < 1)
+    usage(argv[0]);
+
+  if (micro) {
+    /* primitive microbenchmarks: no simulation runs */
+    sim_srand(rngseed);
+    run_microbench(microiters);
+    return EXIT_SUCCESS;
+  }
+
+  /* record at the TRACE level, or everything if tracing is off; with no
+     trace file the runtime levels stay 0 and every LOG point is one
+     untaken branch */
+  if (binlog)
+    log_setlevel(TRACE > 0 ? TRACE : LOG_COMPILE_LEVEL);
+
+  if (restorefile != NULL) {
+    /* resume a checkpointed run; all configuration - channel
+       parameters, window sizes, protocol options - comes from the
+       snapshot, not the command line */
+    restore_checkpoint(restorefile);
+    run_loop();
+    print_report();
+    if (statsprefix != NULL)
+      stats_export(statsprefix);
+    log_close();
+    res_close();
+    return EXIT_SUCCESS;
+  }
+
+  if (replayfile != NULL) {
+    /* deterministic replay: same window configuration, no RNG draws */
+    SR_configure(windowv[0], seqspacearg);
+    reset_run();
+    init_flows();
+    run_replay(replayfile, maxevents);
+    print_report();
+    log_close();
+    res_close();
+    return EXIT_SUCCESS;
+  }
+
+  if (nreps > 0) {
+    /* replication study: one parameter cell, many seeds, all cores */
+    if (nloss > 1 || ncorr > 1 || nlambda > 1 || nwindow > 1) {
+      printf("replications (-R) take a single value per parameter\n");
+      exit(EXIT_FAILURE);
+    }
+    repcfg.nsimmax = nsimmax;
+    repcfg.lossprob = lossv[0];
+    repcfg.corruptprob = corruptv[0];
+    repcfg.corruptdirection = corruptdirection;
+    repcfg.lambda = lambdav[0];
+    repcfg.window = windowv[0];
+    repcfg.seqspace = seqspacearg;
+    repcfg.seed = rngseed;
+    run_replications(nreps, nthreads);
+    log_close();
+    res_close();
+    return EXIT_SUCCESS;
+  }
+
+  csv = (nloss > 1 || ncorr > 1 || nlambda > 1 || nwindow > 1);
+  if (csv)
+    printf("lossprob,corruptprob,lambda,windowsize,nsimmax,msgs_sent,"
+           "window_full,new_ACKs,packets_resent,packets_received,"
+           "messages_delivered,sim_time,events,events_per_sec\n");
+
+  for (i = 0; i < nloss; i++)
+    for (j = 0; j < ncorr; j++)
+      for (k = 0; k < nlambda; k++)
+        for (m = 0; m < nwindow; m++)
+          run_cell(lossv[i], corruptv[j], lambdav[k], windowv[m],
+                   seqspacearg, csv);
+
+  if (capture_file != NULL)
+    fclose(capture_file);
+  if (statsprefix != NULL)
+    stats_export(statsprefix);
+  log_close();
+  res_close();
+  return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 extern int TRACE;
 
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
+/* nonzero: layer 5 generates messages at both entities and the
+   protocol runs a connection in each direction */
+extern int bidirectional;
+
+/* statistics updated by GBN.  Thread-local: each worker thread in the
+   replication engine is an independent simulation instance. */
+extern __thread int total_ACKs_received;
+extern __thread int packets_resent;       /* count of the number of packets resent  */
+extern __thread int new_ACKs;      /* count of the number of acks correctly received */
+extern __thread int packets_received;  /* count of the packets received by receiver */
+extern __thread int window_full; /* count of the number of messages dropped due to full window */
 
 #define   A    0
 #define   B    1
@@ -15,8 +20,13 @@ extern int window_full; /* count of the number of messages dropped due to full w
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
   char data[20];
+  int length;   /* valid bytes in data, 1..20 */
+  int eom;      /* nonzero: last segment of an application message */
 };
 
+/* largest application message the segmentation layer accepts (bytes) */
+#define MSG_MAXLEN 65536
+
 /* a packet is the data unit passed from layer 4 (students code) to layer */
 /* 3 (teachers code).  Note the pre-defined packet structure, which all   */
 /* students must follow. */
@@ -24,17 +34,44 @@ struct pkt {
   int seqnum;
   int acknum;
   int checksum;
+  int length;   /* valid payload bytes, 0..20; 0 on pure ACKs */
+  int eom;      /* nonzero: this segment ends an application message */
   char payload[20];
 };
 
+/* current simulated time */
+extern float sim_now(void);
+
 /* send to A or B (int), packet to send */
-extern void tolayer3(int, struct pkt);  
+extern void tolayer3(int, struct pkt);
+
+/* zero-copy variant: caller passes a pointer and keeps ownership; the
+   channel copies once into its own pool packet */
+extern void tolayer3_pkt(int, const struct pkt *);
+
+/* packet pool, for protocol code on the zero-copy path */
+extern struct pkt *pkt_alloc(void);
+extern void pkt_free(struct pkt *);
 
 /* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
+extern void tolayer5(int, char[20]);
+extern void tolayer5_batch(int, struct pkt * const [], int);
+
+/* deliver one reassembled variable-length message to A or B (int) */
+extern void tolayer5_msg(int, const char *, int);
 
 /* start timer at A or B (int), increment */
 extern void starttimer(int, double);       
 
 /* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern void stoptimer(int);
+
+/* reschedule the running timer at A or B (int) for increment from now;
+   cheaper than a stoptimer()/starttimer() pair.  Starts the timer if it
+   is not running. */
+extern void resettimer(int, double);
+
+/* per-packet timers: independent timer per (entity, seqnum); expiry
+   calls A_packettimeout()/B_packettimeout() with the seqnum */
+extern void starttimer_seq(int, int, double);
+extern void stoptimer_seq(int, int);
@@ -0,0 +1,76 @@
+/* Buffered, leveled trace log.
+   The per-packet printf tracing in sr.c / emulator.c cost an order of
+   magnitude at high TRACE levels and left branches on the hot path even
+   at TRACE 0.  Hot-path trace points now append fixed-size binary
+   records to a per-thread ring buffer (lock-free: each thread owns its
+   ring) which drains to a file when full and at exit.  Levels are per
+   subsystem: a compile-time floor (LOG_COMPILE_LEVEL) removes trace
+   points entirely, and a runtime level per subsystem gates the rest
+   with a single branch. */
+
+#ifndef LOG_H
+#define LOG_H
+
+/* subsystems */
+enum {
+  LOG_EVQ,      /* event queue / scheduler */
+  LOG_CHAN,     /* channel: tolayer3 loss/corruption/delivery */
+  LOG_SND,      /* SR sender (A) */
+  LOG_RCV,      /* SR receiver (B) */
+  LOG_NSUBSYS
+};
+
+/* record codes; a and b hold the code-specific values noted here */
+enum {
+  LOGC_SEND_NEW = 1,    /* a: seqnum */
+  LOGC_WINDOW_FULL,
+  LOGC_ACK_OK,          /* a: acknum */
+  LOGC_ACK_DUP,         /* a: acknum */
+  LOGC_ACK_CORRUPT,
+  LOGC_SACK_MARK,       /* a: seqnum */
+  LOGC_CUM_MARK,        /* a: seqnum, marked via the cumulative edge */
+  LOGC_NAK_RETX,        /* a: seqnum, resent on a NAK bitmap hole */
+  LOGC_TIMEOUT_RESEND,  /* a: seqnum */
+  LOGC_RCV_OK,          /* a: seqnum */
+  LOGC_RCV_OUTSIDE,     /* a: seqnum */
+  LOGC_RCV_CORRUPT,
+  LOGC_EVQ_INSERT,      /* a: evtype, b: entity, f: evtime */
+  LOGC_L3_LOST,
+  LOGC_L3_CORRUPT,
+  LOGC_L3_SEND          /* a: seqnum, b: acknum, f: arrival time */
+};
+
+/* one fixed-stride binary record; t is the simulated time of emission */
+struct log_rec {
+  float t;
+  unsigned char subsys;
+  unsigned char level;
+  unsigned char code;
+  unsigned char pad;
+  int a;
+  int b;
+  float f;
+};
+
+/* compile-time floor: trace points above this level compile away */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 4
+#endif
+
+extern int log_level[LOG_NSUBSYS];   /* runtime level per subsystem */
+
+/* route records to a binary log file (enables recording); drained when
+   the ring fills and again at log_close()/exit */
+extern void log_open(const char *path);
+extern void log_setlevel(int level);             /* all subsystems */
+extern void log_emit(int subsys, int level, int code, int a, int b, float f);
+extern void log_flush(void);
+extern void log_close(void);
+
+#define LOG_ON(ss, lvl) \
+  ((lvl) <= LOG_COMPILE_LEVEL && (lvl) <= log_level[ss])
+
+#define LOG(ss, lvl, code, a, b, f) \
+  do { if (LOG_ON(ss, lvl)) log_emit(ss, lvl, code, a, b, f); } while (0)
+
+#endif /* LOG_H */
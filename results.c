@@ -0,0 +1,111 @@
+/* Binary results writer (see results.h).
+   The file is header, schema text, then a fixed-stride array of
+   res_rec - so a sweep's output mmaps directly: seek to data_off and
+   index records by stride.  Records are streamed as runs complete;
+   only the record count in the header is written back at close. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "results.h"
+
+static FILE *res_file = NULL;
+static unsigned int res_count = 0;
+
+/* one line per field: "name:type:offset:count".  Generated from
+   offsetof so the schema can never drift from the struct. */
+#define SCHEMA_FIELD(name, type, count) \
+  "%s:%s:%u:%u\n", #name, #type, (unsigned)offsetof(struct res_rec, name), \
+  (unsigned)(count)
+
+static int schema_print(char *buf, size_t cap)
+{
+  int n = 0;
+
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lossprob, float, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(corruptprob, float, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lambda, float, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(window, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(seqspace, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(nflows, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(nsimmax, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(nsim, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(window_full, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(new_ACKs, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(packets_resent, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(packets_received, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(messages_delivered, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(ntolayer3, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(nlost, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(ncorrupt, int, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(sim_time, float, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(wall, double, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(events, long, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lat_count, long, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lat_sum, double, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lat_max, float, 1));
+  n += snprintf(buf + n, cap - n, SCHEMA_FIELD(lat_mag, long, RES_LAT_MAGS));
+  return n;
+}
+
+void res_open(const char *path)
+{
+  struct res_hdr h;
+  char schema[2048];
+  int slen;
+
+  res_file = fopen(path, "wb");
+  if (res_file == NULL) {
+    printf("results: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  slen = schema_print(schema, sizeof(schema));
+
+  memset(&h, 0, sizeof(h));
+  h.magic = RES_MAGIC;
+  h.version = RES_VERSION;
+  h.schema_off = sizeof(h);
+  h.schema_len = slen;
+  /* records start at the next 8-byte boundary after the schema */
+  h.data_off = (h.schema_off + slen + 7u) & ~7u;
+  h.rec_size = sizeof(struct res_rec);
+  h.nrecords = 0;
+
+  fwrite(&h, sizeof(h), 1, res_file);
+  fwrite(schema, 1, slen, res_file);
+  if (fseek(res_file, h.data_off, SEEK_SET) != 0) {
+    printf("results: cannot write %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  res_count = 0;
+}
+
+void res_emit(const struct res_rec *rec)
+{
+  if (res_file == NULL)
+    return;
+  if (fwrite(rec, sizeof(*rec), 1, res_file) != 1) {
+    printf("results: short write\n");
+    exit(EXIT_FAILURE);
+  }
+  res_count++;
+}
+
+int res_recording(void)
+{
+  return res_file != NULL;
+}
+
+void res_close(void)
+{
+  if (res_file == NULL)
+    return;
+  /* patch the record count into the header */
+  if (fseek(res_file, offsetof(struct res_hdr, nrecords), SEEK_SET) == 0)
+    fwrite(&res_count, sizeof(res_count), 1, res_file);
+  fclose(res_file);
+  res_file = NULL;
+}
@@ -0,0 +1,77 @@
+/* Binary results writer (-O): one fixed-stride record per completed
+   run, streamed into a file laid out for mmap consumption.  The header
+   carries the record stride and the offset of the record array, plus a
+   self-describing schema (one "name:type:offset:count" line per field)
+   so analysis tooling can locate columns without recompiling against
+   this header.  The record count is patched into the header when the
+   file is closed. */
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#define RES_MAGIC   0x53725231   /* "SrR1" */
+#define RES_VERSION 1
+
+#define RES_LAT_MAGS 32   /* latency histogram magnitudes (see stats.c) */
+
+struct res_hdr {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int data_off;     /* file offset of the record array */
+  unsigned int rec_size;     /* stride of one record, in bytes */
+  unsigned int nrecords;     /* records in the array; patched on close */
+  unsigned int schema_off;   /* offset of the schema text */
+  unsigned int schema_len;   /* bytes of schema text */
+  unsigned int pad;          /* keep the header 8-byte aligned */
+};
+
+/* one completed run (a sweep cell, or a single batch run) */
+struct res_rec {
+  /* the cell's coordinates */
+  float lossprob;
+  float corruptprob;
+  float lambda;
+  int window;
+  int seqspace;
+  int nflows;
+
+  /* the counters from the terminal report */
+  int nsimmax;
+  int nsim;
+  int window_full;
+  int new_ACKs;
+  int packets_resent;
+  int packets_received;
+  int messages_delivered;
+  int ntolayer3;
+  int nlost;
+  int ncorrupt;
+  float sim_time;
+  float pad;
+
+  /* engine cost */
+  double wall;               /* wall-clock seconds for the run */
+  long events;               /* events processed */
+
+  /* layer5-to-layer5 latency (flow 0; populated when -M recording is
+     on): count/sum/max plus per-magnitude histogram totals */
+  long lat_count;
+  double lat_sum;
+  float lat_max;
+  float pad2;
+  long lat_mag[RES_LAT_MAGS];
+};
+
+/* route records to a binary results file (enables recording) */
+extern void res_open(const char *path);
+
+/* append one record; no-op until res_open() */
+extern void res_emit(const struct res_rec *rec);
+
+/* nonzero once res_open() has been called */
+extern int res_recording(void);
+
+/* patch the record count and close the file; called at exit */
+extern void res_close(void);
+
+#endif /* RESULTS_H */
@@ -1,318 +1,1472 @@
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdbool.h>
-#include "emulator.h"
-#include "sr.h"
-
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
-#define SEQSPACE 12     /* the min sequence space for SR must be at least windowsize * 2 */
-#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
-
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
-{
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ ) 
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
-}
-
-bool IsCorrupted(struct pkt packet)
-{
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
-}
-
-
-/********* Sender (A) variables and functions ************/
-
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static bool acked[WINDOWSIZE];         /* tracks which packets are ACKed */ 
-static int send_base;                  /* the base of the send window */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static bool timer_running;             /* indicates if the timer is currently running */
-
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
-{
-  struct pkt sendpkt;
-  int i;
-  int buf_index;
-
-  /* if not blocked waiting on ACK */
-  if (windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for (i=0; i<20; i++) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-    /* put packet in window buffer */
-    buf_index = A_nextseqnum % WINDOWSIZE;
-    buffer[buf_index] = sendpkt;
-    acked[buf_index] = false;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3(A, sendpkt);
-
-    /* Start timer only if this is the first packet in the window */
-    if (windowcount == 0 && !timer_running) {
-      timer_running = true;
-      starttimer(A, RTT);
-    }
-
-    /* get next sequence number, wrap back to 0 */
-    windowcount++;
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;  
-  }
-  /* if blocked, window is full */
-  else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
-  }
-}
-
-/* called from layer 3, when a packet arrives for layer 4 
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
-{
-  int index;
-
-  /* if received ACK is not corrupted */ 
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n", packet.acknum);
-    total_ACKs_received++;
-
-    /* check if ACK is within current window */
-    if (((send_base <= (send_base + WINDOWSIZE - 1) % SEQSPACE) && 
-         (packet.acknum >= send_base && packet.acknum <= (send_base + WINDOWSIZE - 1) % SEQSPACE)) || 
-        ((send_base > (send_base + WINDOWSIZE - 1) % SEQSPACE) && 
-         (packet.acknum >= send_base || packet.acknum <= (send_base + WINDOWSIZE - 1) % SEQSPACE))) {
-      
-      /* calculate buffer index */
-      index = packet.acknum % WINDOWSIZE;
-
-      /* Check if the ACK is for a duplicate packet */
-      if (acked[index]) {
-        if (TRACE > 0)
-          printf("----A: duplicate ACK received, do nothing!\n");
-      } else {
-        if (TRACE > 0)
-          printf("----A: ACK %d is not a duplicate\n", packet.acknum);
-        new_ACKs++;
-        
-        acked[index] = true;
-        
-        /* if the ACK is for the first packet in the window (oldest unacknowledged),
-           we need to move the window forward and restart the timer for the next oldest */
-        if (packet.acknum == send_base) {
-          /* Stop the current timer since the oldest packet has been ACKed */
-          stoptimer(A);
-          timer_running = false;
-          
-          /* Move the window forward past all ACKed packets */
-          while (acked[send_base % WINDOWSIZE]) {
-            acked[send_base % WINDOWSIZE] = false;
-            send_base = (send_base + 1) % SEQSPACE;
-            windowcount--;
-
-            if (windowcount == 0) {
-              break;
-            }
-          }
-          
-          /* If there are still unACKed packets, restart the timer for the new oldest */
-          if (windowcount > 0) {
-            timer_running = true;
-            starttimer(A, RTT);
-          }
-        }
-        /* If it's not the base packet that was ACKed, we don't touch the timer */
-      } 
-    } else {
-      if (TRACE > 0)
-        printf("----A: duplicate ACK received, do nothing!\n");
-    }
-  } else {
-    if (TRACE > 0)
-      printf("----A: corrupted ACK is received, do nothing!\n");
-  }
-}
-
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
-{
-  int index;
-  
-  if (TRACE > 0)
-    printf("----A: time out, resend packets!\n");
-
-  /* Timeout for the oldest unACKed packet (at send_base) */
-  index = send_base % WINDOWSIZE;
-  
-  /* Resend just the oldest unacknowledged packet */
-  if (!acked[index]) {
-    if (TRACE > 0)
-      printf("---A: resending packet %d\n", buffer[index].seqnum);
-    
-    tolayer3(A, buffer[index]);
-    packets_resent++;
-    
-    /* Restart the timer for the same packet */
-    timer_running = true;
-    starttimer(A, RTT);
-  }
-}
-
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
-{
-  int i;
-
-  /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  send_base = 0;
-  windowcount = 0;
-  timer_running = false;
-
-  /* Initialize acked array */
-  for (i = 0; i < WINDOWSIZE; i++) {
-    acked[i] = true;
-  }
-}
-
-/********* Receiver (B)  variables and procedures ************/
-
-static struct pkt rcv_buffer[WINDOWSIZE]; /* buffer for out-of-order packets */\
-static bool rcv_acked[WINDOWSIZE];        /* tracks which packets are received */
-static int rcv_base;                      /* base of the receive window */
-static int B_nextseqnum;                  /* the sequence number for the next packets sent by B */
-
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
-{
-  struct pkt sendpkt;
-  int i;
-  int packet_index;
-
-  /* if packet is not corrupted */
-  if (!IsCorrupted(packet)) {
-    int rcv_last = (rcv_base + WINDOWSIZE - 1) % SEQSPACE;
-
-    /* Check if the seqnum is within our receive window */ 
-    bool in_window = (rcv_base <= rcv_last && packet.seqnum >= rcv_base && packet.seqnum <= rcv_last) ||
-                     (rcv_base > rcv_last && (packet.seqnum >= rcv_base || packet.seqnum <= rcv_last));
-
-    if (in_window) {
-      /* SR: Accept packet in window and send ACK for it */
-      if (TRACE > 0)
-        printf("----B: packet %d is correctly received, send ACK!\n", packet.seqnum);
-      packets_received++;
-
-      /* Buffer the packet if not already received */
-      packet_index = packet.seqnum % WINDOWSIZE;
-      rcv_buffer[packet_index] = packet;
-      rcv_acked[packet_index] = true;
-
-      /* Deliver in-order packets to layer 5 */
-      if (packet.seqnum == rcv_base) {
-        while (rcv_acked[rcv_base % WINDOWSIZE]) {
-          tolayer5(B, rcv_buffer[rcv_base % WINDOWSIZE].payload);
-          
-          /* Mark as not received for future use */
-          rcv_acked[rcv_base % WINDOWSIZE] = false;
-          
-          /* Advance base */
-          rcv_base = (rcv_base + 1) % SEQSPACE;
-        }
-      }
-
-      /* send an ACK for the received packet */
-      sendpkt.acknum = packet.seqnum;     
-    } else {
-      /* Packet is outside our window - could be a duplicate */
-      if (TRACE > 0) 
-        printf("----B: packet outside window, resend ACK!\n");
-
-      /* For SR, still ACK this packet (even if it's before our window) */
-      sendpkt.acknum = packet.seqnum;
-    }
-  } else {
-    /* Packet is corrupted */
-    if (TRACE > 0)
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-
-    /* No valid ACK to send */
-    if (rcv_base == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = rcv_base - 1;
-  }
-
-  /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
-
-  /* we don't have any data to send, fill payload with 0's */
-  for (i = 0; i < 20; i++) {  
-    sendpkt.payload[i] = '0';
-  }
-
-  /* compute checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt);
-
-  /* send out packet */
-  tolayer3(B, sendpkt);
-}
-
-/* the following routine will be called once (only) before any other */
-/* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
-{
-  int i;
-
-  rcv_base = 0;
-  B_nextseqnum = 1;
-
-  /* Initialize receiver buffer */
-  for (i = 0; i < WINDOWSIZE; i++) {
-    rcv_acked[i] = false;
-  }
-}
-
-/******************************************************************************
- * The following functions need be completed only for bi-directional messages *
- *****************************************************************************/
-
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)  
-{
-}
-
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
-{
-}
\ No newline at end of file
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "emulator.h"
+#include "sr.h"
+#include "log.h"
+#include "stats.h"
+
+#define RTT  16.0       /* initial retransmission timeout, until RTT samples arrive */
+#define RTO_MIN 1.0     /* floor: below the minimum one-way channel delay doubled */
+#define RTO_MAX 60.0    /* floor of the backoff cap; the real cap scales
+                           with the window (see configure_state) */
+#define DEFAULT_WINDOWSIZE 8   /* used when SR_configure() is not called or given 0 */
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define SENDQ_CAP 4096  /* messages the layer 5 send queue holds while the window is full */
+#define DELACK_TIMEOUT 5.0  /* how long an ACK may wait for a data packet to ride on */
+#define DELIVER_BATCH 32    /* in-order packets handed to layer 5 per batch call */
+
+/* Window size and sequence space are runtime parameters so that window
+   sweeps do not need a recompile per data point.  Both are rounded up
+   to powers of two: slot and sequence arithmetic then reduce to a mask
+   (seq & slotmask / seq & seqmask) instead of a divide on every access,
+   and a power-of-two seqspace that is a multiple of the slot count keeps
+   the seq-to-slot mapping consistent across sequence wraparound. */
+
+/* All mutable protocol state lives in an instance struct rather than
+   file-scope globals, so independent simulations (one per worker thread
+   in the replication engine) do not trample each other.  The fixed A/B
+   entry points operate on the current instance, which defaults to a
+   thread-local one - each thread is an independent simulation. */
+struct sr_state {
+  int windowsize;        /* max buffered unacked packets */
+  int seqspace;          /* must be at least windowsize * 2 for SR */
+  int slotmask;          /* windowsize - 1 */
+  int seqmask;           /* seqspace - 1 */
+
+  /* sender (A) side.  Window bookkeeping is structure-of-arrays: the
+     28-byte packets sit in their own ring touched only on send/resend,
+     while the per-slot ACK flags are packed one bit per slot so the
+     base-advance scan reads a word of flags at a time instead of
+     striding through memory interleaved with cold payloads. */
+  struct pkt *buffer;    /* ring (windowsize slots) of packets waiting for ACK */
+  unsigned long long *ack_bits;  /* packed per-slot ACK flags, bit i = slot i */
+  int ack_words;         /* 64-bit words allocated in ack_bits */
+  float *sendtime;       /* per slot: when the packet was (first) sent */
+  bool *retxed;          /* per slot: retransmitted, so no RTT sample (Karn) */
+  int send_base;         /* the base of the send window */
+  int A_nextseqnum;      /* the next sequence number to be used by the sender */
+  int windowcount;       /* the number of packets currently awaiting an ACK */
+
+  /* adaptive retransmission timeout (Jacobson/Karels): smoothed RTT and
+     variance feed rto = srtt + 4*rttvar, clamped to [RTO_MIN, rto_max].
+     The fixed RTT of 16 was both too aggressive under queueing delay
+     (spurious resends) and too slow on an idle link. */
+  float srtt;            /* smoothed RTT; 0 until the first sample */
+  float rttvar;          /* smoothed mean deviation of the RTT */
+  float rto;             /* current retransmission timeout */
+  float rto_max;         /* timeout cap, scaled to the window's queueing RTT */
+
+  /* optional congestion window over the send window: slow start below
+     ssthresh, additive increase above it, multiplicative decrease on
+     loss.  Caps admission of new packets only; the protocol window
+     stays windowsize, so ACK validity is unaffected. */
+  float cwnd;            /* congestion window, in packets */
+  float ssthresh;        /* slow start threshold */
+  int dupacks;           /* consecutive duplicate ACKs seen */
+
+  /* bounded FIFO of layer 5 messages waiting for a window slot, so a
+     full window means backpressure instead of data loss; drained as
+     ACKs free slots */
+  struct msg *sendq;     /* ring of SENDQ_CAP queued messages */
+  int sendq_head;        /* oldest queued message */
+  int sendq_len;         /* queued message count */
+
+  /* receiver (B) side */
+  struct pkt **rcv_buffer; /* ring (windowsize slots) of owned pool packets */
+  int rcv_slots;           /* allocated ring size, for cleanup on re-init */
+  bool *rcv_acked;         /* tracks which packets are received */
+  int rcv_base;           /* base of the receive window */
+  int B_nextseqnum;       /* the sequence number for the next packets sent by B */
+
+  /* ACK cache: one pre-built, pre-checksummed ACK packet per acknum.
+     Under high loss most ACKs are duplicates of one already sent, and
+     rebuilding one means zeroing 20 payload bytes and recomputing the
+     checksum; a cache hit resends the stored packet as-is.  rcv_gen
+     counts receive-window changes, and an entry is valid only if it
+     was built at the current generation (window state feeds the SACK
+     bitmap and anchor). */
+  struct pkt *ack_cache;   /* seqspace entries, indexed by acknum */
+  unsigned *ack_cache_gen; /* generation each entry was built at; 0 = never */
+  unsigned rcv_gen;        /* current receive-window generation, starts at 1 */
+
+  /* reassembly buffer for variable-length messages: segment payloads
+     of the message in progress accumulate here until its eom segment
+     arrives.  Allocated once and reused (grown by doubling, capped at
+     MSG_MAXLEN), so large messages cost one buffer per direction, not
+     per-event storage. */
+  char *rasm;              /* partial message bytes, in order */
+  int rasm_len;            /* bytes accumulated so far */
+  int rasm_cap;            /* allocated size of rasm */
+};
+
+static __thread struct sr_state sr_default;
+static __thread struct sr_state *srs;   /* current instance, set lazily */
+
+/* Bidirectional mode runs a second, independent SR connection for the
+   B-to-A direction: sr_reverse's sender half lives at B and its
+   receiver half at A, mirroring how srs carries A-to-B traffic.  In
+   this mode ACKs are piggybacked: a receiver holds its ACK for up to
+   DELACK_TIMEOUT hoping a reverse-direction data packet will carry it
+   in acknum, and only sends a standalone ACK (seqnum == NOTINUSE) when
+   the delayed-ACK timer - the otherwise idle per-entity timer - fires.
+   Packet events are the simulator's unit of cost, so piggybacking
+   roughly halves the work per delivered message. */
+static __thread struct sr_state sr_reverse;
+
+/* delayed-ACK state, per entity */
+static __thread int pending_ack[2];
+static __thread bool ack_pending[2];
+
+/* process-wide protocol options, set once before any runs start (like
+   TRACE, they are configuration, not per-instance state) */
+static int sack_enabled = 0;
+static int cc_enabled = 0;
+static int cum_enabled = 0;
+static int nak_enabled = 0;
+
+void SR_enable_sack(int on)
+{
+  sack_enabled = on;
+}
+
+void SR_enable_cc(int on)
+{
+  cc_enabled = on;
+}
+
+void SR_enable_cumack(int on)
+{
+  cum_enabled = on;
+}
+
+void SR_enable_nak(int on)
+{
+  nak_enabled = on;
+}
+
+/* true if seq lies within the windowsize-sized window starting at base */
+static bool in_window(const struct sr_state *s, int base, int seq)
+{
+  int last = (base + s->windowsize - 1) & s->seqmask;
+
+  if (base <= last)
+    return (seq >= base && seq <= last);
+  return (seq >= base || seq <= last);
+}
+
+/* single-bit accessors for the packed ACK bitmap */
+static bool ack_test(const struct sr_state *s, int slot)
+{
+  return (s->ack_bits[slot >> 6] >> (slot & 63)) & 1ULL;
+}
+
+static void ack_set(struct sr_state *s, int slot)
+{
+  s->ack_bits[slot >> 6] |= 1ULL << (slot & 63);
+}
+
+static void ack_clear(struct sr_state *s, int slot)
+{
+  s->ack_bits[slot >> 6] &= ~(1ULL << (slot & 63));
+}
+
+/* number of SACK bits an ACK payload can carry */
+#define SACK_BITS 160   /* 20 payload bytes */
+
+static struct sr_state *sr_cur(void)
+{
+  if (srs == NULL)
+    srs = &sr_default;
+  return srs;
+}
+
+/* Multi-flow support: with more than one flow the protocol state is an
+   array of instances, and the emulator selects the instance matching
+   the event being dispatched before calling the role-based entry
+   points.  One flow keeps the classic single-instance path (and
+   bidirectional mode, which the flow array does not carry). */
+static int sr_nflows = 1;
+static __thread struct sr_state *flow_states = NULL;
+
+/* the -M statistics cover flow 0's sender only; every stats hook below
+   checks this so other flows cannot push or pop flow 0's samples */
+static __thread int sr_cur_flow = 0;
+
+void SR_set_nflows(int n)
+{
+  sr_nflows = (n > 1) ? n : 1;
+}
+
+void SR_select_flow(int f)
+{
+  sr_cur_flow = f;
+  if (sr_nflows <= 1)
+    return;
+  if (flow_states == NULL) {
+    flow_states = calloc(sr_nflows, sizeof(struct sr_state));
+    if (flow_states == NULL) {
+      printf("memory allocation for flow states failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  srs = &flow_states[f];
+}
+
+static int roundpow2(int x)
+{
+  int p = 1;
+  while (p < x)
+    p <<= 1;
+  return p;
+}
+
+static void configure_state(struct sr_state *s, int window, int space)
+{
+  if (window <= 0)
+    window = DEFAULT_WINDOWSIZE;
+  s->windowsize = roundpow2(window);
+  if (space < 2*s->windowsize)
+    space = 2*s->windowsize;
+  s->seqspace = roundpow2(space);
+  s->slotmask = s->windowsize - 1;
+  s->seqmask = s->seqspace - 1;
+  /* The FIFO channel serializes packets, so a full window has a
+     queueing RTT near windowsize times the per-packet delay (at most
+     10 under the classic model) - and Karn's rule means the estimator
+     never observes it once packets start retransmitting.  A fixed cap
+     below that RTT locks the sender into resending faster than the
+     channel drains, which never terminates; scale the cap so backoff
+     can always climb past the real RTT. */
+  s->rto_max = (float)s->windowsize * 10.0f;
+  if (s->rto_max < RTO_MAX)
+    s->rto_max = RTO_MAX;
+}
+
+void SR_configure(int window, int space)
+{
+  int f;
+
+  if (sr_nflows > 1) {
+    SR_select_flow(0);   /* allocates the flow array on first use */
+    for (f = 0; f < sr_nflows; f++)
+      configure_state(&flow_states[f], window, space);
+  }
+  else
+    configure_state(sr_cur(), window, space);
+  configure_state(&sr_reverse, window, space);   /* for bidirectional mode */
+}
+
+/* Sum the 20 payload bytes eight lanes at a time (SWAR): two 64-bit
+   loads and one 32-bit load replace the byte-at-a-time loop, with the
+   per-lane totals folded in log steps.  Byte values are summed as
+   plain char, matching the original scalar loop exactly: unsigned
+   lane sums are corrected by counting high-bit bytes where char is
+   signed. */
+int PayloadDigest(const char payload[20])
+{
+  const unsigned long long BYTE_LO = 0x00FF00FF00FF00FFULL;
+  const unsigned long long HALF_LO = 0x0000FFFF0000FFFFULL;
+  unsigned long long w, lo;
+  unsigned int wd, neg, sum;
+  int i;
+
+  neg = 0;
+  sum = 0;
+  for (i = 0; i < 16; i += 8) {
+    memcpy(&w, payload + i, 8);
+    neg += (unsigned)__builtin_popcountll(w & 0x8080808080808080ULL);
+    lo = (w & BYTE_LO) + ((w >> 8) & BYTE_LO);
+    lo = (lo & HALF_LO) + ((lo >> 16) & HALF_LO);
+    sum += (unsigned)(lo + (lo >> 32));
+  }
+  memcpy(&wd, payload + 16, 4);
+  neg += (unsigned)__builtin_popcount(wd & 0x80808080U);
+  wd = (wd & 0x00FF00FFU) + ((wd >> 8) & 0x00FF00FFU);
+  sum += (wd & 0xFFFFU) + (wd >> 16);
+
+#if CHAR_MIN < 0
+  return (int)sum - (int)(neg << 8);   /* bytes >= 0x80 are negative chars */
+#else
+  (void)neg;
+  return (int)sum;
+#endif
+}
+
+/* incremental variant: fold the header fields into a payload digest
+   computed (or known) earlier, so constant payloads - like the all-'0'
+   filler on non-SACK ACKs - are never rehashed */
+int ChecksumWithDigest(int seqnum, int acknum, int payload_digest)
+{
+  return seqnum + acknum + payload_digest;
+}
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+int ComputeChecksum(struct pkt packet)
+{
+  /* length and eom are folded in too; pure ACKs carry 0 in both, so
+     the ChecksumWithDigest() fast path for ACKs stays valid */
+  return ChecksumWithDigest(packet.seqnum, packet.acknum,
+                            PayloadDigest(packet.payload))
+         + packet.length + packet.eom;
+}
+
+bool IsCorrupted(struct pkt packet)
+{
+  if (packet.checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+
+/********* Sender (A) variables and functions ************/
+
+/* effective admission window: the congestion window, when enabled, can
+   only shrink admission below the configured window size */
+static int effective_window(const struct sr_state *s)
+{
+  int wnd = s->windowsize;
+
+  if (cc_enabled) {
+    wnd = (int)s->cwnd;
+    if (wnd < 1)
+      wnd = 1;
+  }
+  return wnd;
+}
+
+/* build a packet for message in me's window slot and transmit it; the
+   caller has checked that the window has room.  In bidirectional mode
+   a waiting ACK rides along in acknum. */
+static void send_message(struct sr_state *s, int me, const struct msg *message)
+{
+  struct pkt *sendpkt;
+  int i;
+  int buf_index;
+
+  /* build the packet directly in its window slot - no staging copy */
+  buf_index = s->A_nextseqnum & s->slotmask;
+  sendpkt = &s->buffer[buf_index];
+  sendpkt->seqnum = s->A_nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  if (ack_pending[me]) {
+    /* piggyback the delayed ACK instead of a standalone packet */
+    sendpkt->acknum = pending_ack[me];
+    ack_pending[me] = false;
+    stoptimer(me);
+  }
+  for (i=0; i<20; i++)
+    sendpkt->payload[i] = message->data[i];
+  sendpkt->length = message->length;
+  sendpkt->eom = message->eom;
+  sendpkt->checksum = ComputeChecksum(*sendpkt);
+  ack_clear(s, buf_index);
+  s->sendtime[buf_index] = sim_now();
+  s->retxed[buf_index] = false;
+
+  /* send out packet */
+  LOG(LOG_SND, 1, LOGC_SEND_NEW, sendpkt->seqnum, 0, 0);
+  tolayer3_pkt(me, sendpkt);
+
+  /* every packet in flight runs its own retransmission timer */
+  starttimer_seq(me, sendpkt->seqnum, s->rto);
+
+  /* get next sequence number, wrap back to 0 */
+  s->windowcount++;
+  s->A_nextseqnum = (s->A_nextseqnum + 1) & s->seqmask;
+  if (me == A && sr_cur_flow == 0)
+    stats_window_sample(sim_now(), s->windowcount);
+}
+
+/* hand one layer 5 message to me's sender: transmit if the window has
+   room, queue while it is full, drop only when the queue is full too */
+static void output_msg(struct sr_state *s, int me, const struct msg *message)
+{
+  /* if not blocked waiting on ACK */
+  if (s->windowcount < effective_window(s)) {
+    send_message(s, me, message);
+  }
+  /* window full: park the message until an ACK frees a slot */
+  else if (s->sendq_len < SENDQ_CAP) {
+    s->sendq[(s->sendq_head + s->sendq_len) & (SENDQ_CAP - 1)] = *message;
+    s->sendq_len++;
+  }
+  /* queue full too: now it really is data loss */
+  else {
+    LOG(LOG_SND, 1, LOGC_WINDOW_FULL, s->A_nextseqnum, 0, 0);
+    window_full++;
+    if (me == A && sr_cur_flow == 0)
+      stats_msg_undo();   /* this message will never reach layer 5 */
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+void A_output(struct msg message)
+{
+  output_msg(srs, A, &message);
+}
+
+/* Segmentation layer: split one variable-length application message
+   into 20-byte segments, each carrying its valid-byte count and an
+   end-of-message flag for reassembly at the receiver.  Admission is
+   all-or-nothing: a segment dropped mid-message would silently corrupt
+   the reassembled data, so the whole message is refused (one
+   window_full) unless the window and send queue together can hold
+   every segment. */
+static void output_data(struct sr_state *s, int me, const char *data, int len)
+{
+  struct msg seg;
+  int off, n, segs, room;
+
+  if (len < 1 || len > MSG_MAXLEN)
+    return;
+
+  segs = (len + 19) / 20;
+  room = (effective_window(s) - s->windowcount) + (SENDQ_CAP - s->sendq_len);
+  if (segs > room) {
+    LOG(LOG_SND, 1, LOGC_WINDOW_FULL, s->A_nextseqnum, 0, 0);
+    window_full++;
+    if (me == A && sr_cur_flow == 0)
+      stats_msg_undo();   /* this message will never reach layer 5 */
+    return;
+  }
+
+  for (off = 0; off < len; off += n) {
+    n = len - off;
+    if (n > 20)
+      n = 20;
+    memcpy(seg.data, data + off, n);
+    memset(seg.data + n, 0, 20 - n);   /* deterministic checksum input */
+    seg.length = n;
+    seg.eom = (off + n >= len);
+    output_msg(s, me, &seg);
+  }
+}
+
+void A_output_data(const char *data, int len)
+{
+  output_data(srs, A, data, len);
+}
+
+/* reverse-direction data only exists in bidirectional mode */
+void B_output_data(const char *data, int len)
+{
+  if (bidirectional)
+    output_data(&sr_reverse, B, data, len);
+}
+
+/* called from layer 3, when a packet arrives for layer 4
+   In this practical this will always be an ACK as B never sends data.
+*/
+/* fold one RTT sample into the smoothed estimators (Jacobson/Karels:
+   gain 1/8 on the mean, 1/4 on the deviation) */
+static void rtt_sample(struct sr_state *s, float sample)
+{
+  float err;
+
+  if (s->srtt == 0.0f) {
+    s->srtt = sample;
+    s->rttvar = sample / 2;
+  } else {
+    err = sample - s->srtt;
+    s->srtt += err / 8;
+    if (err < 0)
+      err = -err;
+    s->rttvar += (err - s->rttvar) / 4;
+  }
+  s->rto = s->srtt + 4*s->rttvar;
+  if (s->rto < RTO_MIN)
+    s->rto = RTO_MIN;
+  if (s->rto > s->rto_max)
+    s->rto = s->rto_max;
+}
+
+/* mark one sequence number ACKed if it is in-window and new; me is the
+   entity whose outbound data is being acknowledged.  Returns true if
+   the packet was newly marked. */
+static bool mark_acked(struct sr_state *s, int me, int seq)
+{
+  int index;
+
+  /* only packets actually outstanding count: a stale duplicate whose
+     sequence number aliases into the window range (the space is only
+     2x the window) must not mark an unsent slot */
+  if (((seq - s->send_base) & s->seqmask) >= s->windowcount)
+    return false;
+  index = seq & s->slotmask;
+  if (ack_test(s, index))
+    return false;
+  ack_set(s, index);
+  stoptimer_seq(me, seq);   /* this packet will not retransmit */
+  /* Karn's rule: only packets sent exactly once give a clean sample */
+  if (!s->retxed[index])
+    rtt_sample(s, sim_now() - s->sendtime[index]);
+  if (cc_enabled) {
+    /* slow start below ssthresh, then additive increase */
+    if (s->cwnd < s->ssthresh)
+      s->cwnd += 1.0f;
+    else
+      s->cwnd += 1.0f / s->cwnd;
+    if (s->cwnd > s->windowsize)
+      s->cwnd = (float)s->windowsize;
+  }
+  if (me == A)
+    new_ACKs++;   /* the terminal counters report A's connection */
+  return true;
+}
+
+/* Move the window forward past all ACKed packets at the base.  The
+   packed bitmap turns the per-slot scan into a find-first-zero: shift
+   the complemented word so bit 0 is the base slot, and the count of
+   trailing zeros is the length of the ACKed run.  The run's bits are
+   cleared in one mask write as the base moves over them. */
+static void advance_send_base(struct sr_state *s)
+{
+  int slot, run, word_left;
+  unsigned long long w;
+
+  while (s->windowcount > 0) {
+    slot = s->send_base & s->slotmask;
+    word_left = 64 - (slot & 63);     /* slots left in this bitmap word */
+    w = ~(s->ack_bits[slot >> 6]) >> (slot & 63);
+    run = (w == 0) ? word_left : __builtin_ctzll(w);
+    if (run == 0)                     /* base itself is unACKed */
+      break;
+    if (run > word_left)              /* ctz ran into the shifted-in zeros */
+      run = word_left;
+    if (run > s->windowcount)
+      run = s->windowcount;
+    if (run > s->windowsize - slot)   /* don't scan past the ring edge */
+      run = s->windowsize - slot;
+    s->ack_bits[slot >> 6] &=
+        ~((run == 64 ? ~0ULL : (1ULL << run) - 1) << (slot & 63));
+    s->send_base = (s->send_base + run) & s->seqmask;
+    s->windowcount -= run;
+  }
+}
+
+/* resend one unACKed packet and flag it for Karn's rule */
+static void retransmit_seq(struct sr_state *s, int me, int seqnum)
+{
+  int index = seqnum & s->slotmask;
+
+  tolayer3_pkt(me, &s->buffer[index]);
+  if (me == A) {
+    packets_resent++;
+    if (sr_cur_flow == 0)
+      stats_retransmit(seqnum);
+  }
+  s->retxed[index] = true;
+}
+
+/* freed slots admit queued layer 5 messages immediately */
+static void drain_sendq(struct sr_state *s, int me)
+{
+  while (s->sendq_len > 0 && s->windowcount < effective_window(s)) {
+    send_message(s, me, &s->sendq[s->sendq_head]);
+    s->sendq_head = (s->sendq_head + 1) & (SENDQ_CAP - 1);
+    s->sendq_len--;
+  }
+}
+
+/* process one acknowledgement (acknum, with the rest of the packet for
+   the SACK bitmap) against me's send window */
+static void process_ack(struct sr_state *s, int me, const struct pkt *packet)
+{
+  int nbits;
+  int seq;
+  int i;
+
+  if (me == A)
+    total_ACKs_received++;
+
+  /* the individually acknowledged packet */
+  if (mark_acked(s, me, packet->acknum)) {
+    LOG(LOG_SND, 1, LOGC_ACK_OK, packet->acknum, 0, 0);
+    s->dupacks = 0;
+  } else {
+    LOG(LOG_SND, 1, LOGC_ACK_DUP, packet->acknum, 0, 0);
+    /* fast recovery: three duplicate ACKs signal a loss before any
+       timer fires - retransmit the window base and halve cwnd rather
+       than collapsing to 1 as a timeout would */
+    if (cc_enabled && ++s->dupacks == 3) {
+      s->dupacks = 0;
+      if (s->windowcount > 0 && !ack_test(s, s->send_base & s->slotmask)) {
+        retransmit_seq(s, me, s->send_base);
+        stoptimer_seq(me, s->send_base);
+        starttimer_seq(me, s->send_base, s->rto);
+      }
+      s->ssthresh = s->cwnd / 2;
+      if (s->ssthresh < 2.0f)
+        s->ssthresh = 2.0f;
+      s->cwnd = s->ssthresh;
+    }
+  }
+
+  /* Cumulative-ACK hybrid: seqnum carries the peer's rcv_base, the
+     next in-order sequence it expects, so everything below that edge
+     is known received and delivered.  One subtraction sizes the run
+     and the bitmap is only consulted for the gap region above it;
+     when individual ACKs die on the reverse path, one surviving ACK
+     recovers the whole run instead of one packet. */
+  if (cum_enabled && !bidirectional) {
+    nbits = (packet->seqnum - s->send_base) & s->seqmask;
+    if (nbits <= s->windowcount) {
+      for (i = 0; i < nbits; i++) {
+        seq = (s->send_base + i) & s->seqmask;
+        if (mark_acked(s, me, seq))
+          LOG(LOG_SND, 1, LOGC_CUM_MARK, seq, 0, 0);
+      }
+    }
+  }
+
+  /* NAK mode: the payload bitmap names the holes in the peer's
+     receive window, each one hard evidence of loss on this in-order
+     channel.  Resend them from the window buffer right away instead
+     of waiting out the retransmission timer - recovery costs half an
+     RTT instead of a full timeout.  retxed gates each seqnum to one
+     NAK-triggered resend (later NAKs for the same hole are echoes of
+     ACKs already in flight); if that resend dies too, the timer still
+     backstops it. */
+  if (nak_enabled && !bidirectional) {
+    nbits = (s->windowsize < SACK_BITS) ? s->windowsize : SACK_BITS;
+    for (i = 0; i < nbits; i++) {
+      if (packet->payload[i >> 3] & (1 << (i & 7))) {
+        seq = (packet->seqnum + i) & s->seqmask;
+        if (((seq - s->send_base) & s->seqmask) < s->windowcount &&
+            !ack_test(s, seq & s->slotmask) &&
+            !s->retxed[seq & s->slotmask]) {
+          LOG(LOG_SND, 1, LOGC_NAK_RETX, seq, 0, 0);
+          retransmit_seq(s, me, seq);
+          stoptimer_seq(me, seq);
+          starttimer_seq(me, seq, s->rto);
+        }
+      }
+    }
+  }
+
+  /* SACK mode: the payload carries a bitmap of the peer's receive
+     window anchored at packet.seqnum, so one surviving ACK can mark
+     every packet the peer holds even when earlier ACKs were lost */
+  if (sack_enabled && !bidirectional) {
+    nbits = (s->windowsize < SACK_BITS) ? s->windowsize : SACK_BITS;
+    for (i = 0; i < nbits; i++) {
+      if (packet->payload[i >> 3] & (1 << (i & 7))) {
+        seq = (packet->seqnum + i) & s->seqmask;
+        if (mark_acked(s, me, seq))
+          LOG(LOG_SND, 1, LOGC_SACK_MARK, seq, 0, 0);
+      }
+    }
+  }
+
+  advance_send_base(s);
+  drain_sendq(s, me);
+}
+
+/* bidirectional receive path, declared below with the receiver code */
+static void bidir_input(int me, struct pkt *packet);
+
+void A_input_pkt(struct pkt *packet)
+{
+  if (bidirectional) {
+    bidir_input(A, packet);
+    return;
+  }
+
+  /* if received ACK is not corrupted */
+  if (!IsCorrupted(*packet)) {
+    process_ack(srs, A, packet);
+  } else {
+    LOG(LOG_SND, 1, LOGC_ACK_CORRUPT, packet->acknum, 0, 0);
+  }
+  pkt_free(packet);   /* ACKs are consumed here */
+}
+
+/* by-value compatibility wrapper */
+void A_input(struct pkt packet)
+{
+  struct pkt *p = pkt_alloc();
+  *p = packet;
+  A_input_pkt(p);
+}
+
+/* the per-packet timer for one of me's packets expired.  Each lost
+   packet retransmits independently, so several losses in one window
+   recover in parallel after a single RTT instead of serially. */
+static void packet_timeout(struct sr_state *s, int me, int seqnum)
+{
+  int index;
+
+  if (TRACE > 0 && me == A)
+    printf("----A: time out, resend packets!\n");
+
+  index = seqnum & s->slotmask;
+
+  /* Resend the packet whose timer expired */
+  if (!ack_test(s, index)) {
+    if (TRACE > 0 && me == A)
+      printf("---A: resending packet %d\n", s->buffer[index].seqnum);
+
+    retransmit_seq(s, me, seqnum);
+
+    /* exponential backoff: repeated losses widen the timeout */
+    s->rto *= 2;
+    if (s->rto > s->rto_max)
+      s->rto = s->rto_max;
+
+    /* multiplicative decrease: a timeout is a strong loss signal, so
+       restart from slow start */
+    if (cc_enabled) {
+      s->ssthresh = s->cwnd / 2;
+      if (s->ssthresh < 2.0f)
+        s->ssthresh = 2.0f;
+      s->cwnd = 1.0f;
+      s->dupacks = 0;
+    }
+
+    /* Restart the timer for the same packet */
+    starttimer_seq(me, seqnum, s->rto);
+  }
+}
+
+void A_packettimeout(int seqnum)
+{
+  packet_timeout(srs, A, seqnum);
+}
+
+/* send the ACK that could not find a data packet to ride on */
+static void send_standalone_ack(int me)
+{
+  struct pkt ack;
+  int i;
+
+  ack.seqnum = NOTINUSE;   /* marks a pure ACK in bidirectional mode */
+  ack.acknum = pending_ack[me];
+  for (i = 0; i < 20; i++)
+    ack.payload[i] = '0';
+  ack.length = 0;
+  ack.eom = 0;
+  ack.checksum = ChecksumWithDigest(ack.seqnum, ack.acknum, '0' * 20);
+  tolayer3_pkt(me, &ack);
+  ack_pending[me] = false;
+}
+
+/* the per-entity timer: the delayed-ACK timer in bidirectional mode,
+   otherwise the legacy single retransmission timer */
+void A_timerinterrupt(void)
+{
+  if (bidirectional) {
+    if (ack_pending[A])
+      send_standalone_ack(A);
+    return;
+  }
+  A_packettimeout(srs->send_base);
+}
+
+/* initialise the sending half of one direction's state */
+static void init_sender_half(struct sr_state *s)
+{
+  int i;
+
+  /* initialise the window, buffer and sequence number */
+  s->A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  s->send_base = 0;
+  s->windowcount = 0;
+
+  /* (re)allocate the window ring at the configured size */
+  free(s->buffer);
+  free(s->ack_bits);
+  free(s->sendtime);
+  free(s->retxed);
+  s->ack_words = (s->windowsize + 63) >> 6;
+  s->buffer = malloc(s->windowsize * sizeof(struct pkt));
+  s->ack_bits = malloc(s->ack_words * sizeof(unsigned long long));
+  s->sendtime = malloc(s->windowsize * sizeof(float));
+  s->retxed = malloc(s->windowsize * sizeof(bool));
+  if (s->sendq == NULL)
+    s->sendq = malloc(SENDQ_CAP * sizeof(struct msg));
+  if (s->buffer == NULL || s->ack_bits == NULL ||
+      s->sendtime == NULL || s->retxed == NULL || s->sendq == NULL) {
+    printf("memory allocation for send window failed.");
+    exit(EXIT_FAILURE);
+  }
+  s->sendq_head = 0;
+  s->sendq_len = 0;
+
+  /* all slots start free; send_message() clears a slot's bit as it is
+     (re)occupied and mark_acked() sets it */
+  for (i = 0; i < s->ack_words; i++)
+    s->ack_bits[i] = 0;
+  for (i = 0; i < s->windowsize; i++) {
+    s->sendtime[i] = 0.0f;
+    s->retxed[i] = false;
+  }
+
+  /* timeout estimator starts at the legacy fixed RTT until samples land */
+  s->srtt = 0.0f;
+  s->rttvar = 0.0f;
+  s->rto = RTT;
+
+  /* congestion control starts in slow start with a one-packet window */
+  s->cwnd = 1.0f;
+  s->ssthresh = (float)s->windowsize;
+  s->dupacks = 0;
+}
+
+/* initialise the receiving half of one direction's state */
+static void init_receiver_half(struct sr_state *s)
+{
+  int i;
+
+  s->rcv_base = 0;
+  s->B_nextseqnum = 1;
+
+  /* recycle packets a previous run left undelivered, then (re)allocate
+     the receive ring at the configured size */
+  for (i = 0; i < s->rcv_slots; i++)
+    if (s->rcv_buffer[i] != NULL)
+      pkt_free(s->rcv_buffer[i]);
+  free(s->rcv_buffer);
+  free(s->rcv_acked);
+  free(s->ack_cache);
+  free(s->ack_cache_gen);
+  s->rcv_buffer = malloc(s->windowsize * sizeof(struct pkt *));
+  s->rcv_acked = malloc(s->windowsize * sizeof(bool));
+  s->ack_cache = malloc(s->seqspace * sizeof(struct pkt));
+  s->ack_cache_gen = malloc(s->seqspace * sizeof(unsigned));
+  s->rcv_slots = s->windowsize;
+  if (s->rcv_buffer == NULL || s->rcv_acked == NULL ||
+      s->ack_cache == NULL || s->ack_cache_gen == NULL) {
+    printf("memory allocation for receive window failed.");
+    exit(EXIT_FAILURE);
+  }
+
+  /* Initialize receiver buffer */
+  for (i = 0; i < s->windowsize; i++) {
+    s->rcv_buffer[i] = NULL;
+    s->rcv_acked[i] = false;
+  }
+
+  /* generation 0 marks every cache entry as never built */
+  for (i = 0; i < s->seqspace; i++)
+    s->ack_cache_gen[i] = 0;
+  s->rcv_gen = 1;
+
+  /* the reassembly buffer survives re-init; just drop any partial message */
+  s->rasm_len = 0;
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void A_init(void)
+{
+  struct sr_state *s = sr_cur();
+
+  if (s->windowsize == 0)
+    SR_configure(0, 0);   /* driver never configured us: use defaults */
+
+  init_sender_half(s);
+  if (bidirectional) {
+    /* A also terminates the reverse connection */
+    init_receiver_half(&sr_reverse);
+    ack_pending[A] = false;
+    pending_ack[A] = NOTINUSE;
+  }
+}
+
+/********* Receiver (B)  variables and procedures ************/
+
+/* called from layer 3, when a packet arrives for layer 4 at B.
+   Takes ownership of the pool packet: in-window data is parked in the
+   receive ring until delivery, everything else is recycled. */
+/* append one segment's payload to the reassembly buffer, growing it by
+   doubling on first contact with larger messages */
+static void rasm_append(struct sr_state *s, const struct pkt *packet)
+{
+  if (s->rasm_len + packet->length > s->rasm_cap) {
+    int cap = (s->rasm_cap > 0) ? s->rasm_cap : 256;
+    while (cap < s->rasm_len + packet->length)
+      cap *= 2;
+    if (cap > MSG_MAXLEN)
+      cap = MSG_MAXLEN;
+    s->rasm = realloc(s->rasm, cap);
+    if (s->rasm == NULL) {
+      printf("memory allocation for reassembly buffer failed.");
+      exit(EXIT_FAILURE);
+    }
+    s->rasm_cap = cap;
+  }
+  memcpy(s->rasm + s->rasm_len, packet->payload, packet->length);
+  s->rasm_len += packet->length;
+}
+
+/* Deliver the contiguous run of buffered in-order packets at the base
+   of me's receive window, handing them to layer 5 in batched calls and
+   recycling them afterwards.  Full 20-byte single-segment packets (the
+   only kind the fixed-size workload produces) take the batch path
+   untouched; anything else is a segment of a variable-length message
+   and goes through the reassembly buffer, delivered whole when its
+   eom segment completes it. */
+static void drain_rcv_window(struct sr_state *s, int me)
+{
+  struct pkt *run[DELIVER_BATCH];
+  struct pkt *p;
+  int packet_index;
+  int n, i;
+  bool moved;
+
+  do {
+    n = 0;
+    moved = false;
+    while (s->rcv_acked[s->rcv_base & s->slotmask]) {
+      packet_index = s->rcv_base & s->slotmask;
+      p = s->rcv_buffer[packet_index];
+      s->rcv_buffer[packet_index] = NULL;
+      s->rcv_acked[packet_index] = false;   /* mark free for future use */
+      s->rcv_base = (s->rcv_base + 1) & s->seqmask;
+      moved = true;
+      if (p->length == 20 && p->eom && s->rasm_len == 0) {
+        run[n++] = p;
+        if (n == DELIVER_BATCH)
+          break;
+      } else {
+        /* segment of a variable-length message: flush the batch first
+           so layer 5 sees everything in arrival order */
+        if (n > 0) {
+          tolayer5_batch(me, run, n);
+          for (i = 0; i < n; i++)
+            pkt_free(run[i]);
+          n = 0;
+        }
+        rasm_append(s, p);
+        if (p->eom) {
+          tolayer5_msg(me, s->rasm, s->rasm_len);
+          s->rasm_len = 0;
+        }
+        pkt_free(p);
+      }
+    }
+    if (n > 0) {
+      tolayer5_batch(me, run, n);
+      for (i = 0; i < n; i++)
+        pkt_free(run[i]);
+    }
+    if (moved)
+      s->rcv_gen++;   /* window moved: cached ACKs are stale */
+  } while (n == DELIVER_BATCH);
+}
+
+/* Send an ACK for acknum out of me's receive window, reusing the
+   cached pre-checksummed packet when the window has not changed since
+   it was built.  Duplicates dominate ACK traffic under high loss, and
+   a hit skips the payload fill (or SACK bitmap walk) and the checksum. */
+static void send_ack(struct sr_state *s, int me, int acknum)
+{
+  struct pkt *sendpkt = &s->ack_cache[acknum & s->seqmask];
+  int i;
+
+  if (s->ack_cache_gen[acknum & s->seqmask] == s->rcv_gen) {
+    tolayer3_pkt(me, sendpkt);   /* straight resend, nothing rebuilt */
+    return;
+  }
+
+  sendpkt->acknum = acknum;
+  sendpkt->length = 0;   /* pure ACK: no payload bytes, no segment end */
+  sendpkt->eom = 0;
+  if (sack_enabled) {
+    int nbits = (s->windowsize < SACK_BITS) ? s->windowsize : SACK_BITS;
+
+    /* seqnum anchors the SACK bitmap; the payload carries one bit per
+       window slot from rcv_base, covering everything B holds buffered */
+    sendpkt->seqnum = s->rcv_base;
+    for (i = 0; i < 20; i++)
+      sendpkt->payload[i] = 0;
+    for (i = 0; i < nbits; i++)
+      if (s->rcv_acked[(s->rcv_base + i) & s->slotmask])
+        sendpkt->payload[i >> 3] |= (char)(1 << (i & 7));
+  } else if (nak_enabled) {
+    int nbits = (s->windowsize < SACK_BITS) ? s->windowsize : SACK_BITS;
+    int highest = -1;
+
+    /* NAK mode: the payload carries a bitmap of the holes in the
+       receive window, anchored at rcv_base like the SACK bitmap but
+       inverted.  The channel never reorders, so a hole below the
+       newest buffered packet is hard evidence of loss or corruption -
+       only bits below that point are raised. */
+    sendpkt->seqnum = s->rcv_base;
+    for (i = 0; i < 20; i++)
+      sendpkt->payload[i] = 0;
+    for (i = 0; i < nbits; i++)
+      if (s->rcv_acked[(s->rcv_base + i) & s->slotmask])
+        highest = i;
+    for (i = 0; i < highest; i++)
+      if (!s->rcv_acked[(s->rcv_base + i) & s->slotmask])
+        sendpkt->payload[i >> 3] |= (char)(1 << (i & 7));
+  } else if (cum_enabled) {
+    /* seqnum carries the cumulative edge: the next in-order sequence
+       this receiver expects (everything below is delivered) */
+    sendpkt->seqnum = s->rcv_base;
+
+    /* we don't have any data to send, fill payload with 0's */
+    for (i = 0; i < 20; i++) {
+      sendpkt->payload[i] = '0';
+    }
+  } else {
+    sendpkt->seqnum = s->B_nextseqnum;
+    s->B_nextseqnum = (s->B_nextseqnum + 1) % 2;
+
+    /* we don't have any data to send, fill payload with 0's */
+    for (i = 0; i < 20; i++) {
+      sendpkt->payload[i] = '0';
+    }
+  }
+
+  /* compute checksum; the plain filler payload has a known digest
+     ('0' times 20), so only the header fields are folded in */
+  if (sack_enabled || nak_enabled)
+    sendpkt->checksum = ChecksumWithDigest(sendpkt->seqnum, sendpkt->acknum,
+                                           PayloadDigest(sendpkt->payload));
+  else
+    sendpkt->checksum = ChecksumWithDigest(sendpkt->seqnum, sendpkt->acknum,
+                                           '0' * 20);
+
+  s->ack_cache_gen[acknum & s->seqmask] = s->rcv_gen;
+  tolayer3_pkt(me, sendpkt);
+}
+
+void B_input_pkt(struct pkt *packet)
+{
+  struct sr_state *s = srs;
+  int acknum;
+  int packet_index;
+
+  if (bidirectional) {
+    bidir_input(B, packet);
+    return;
+  }
+
+  /* if packet is not corrupted */
+  if (!IsCorrupted(*packet)) {
+    /* Check if the seqnum is within our receive window */
+    if (in_window(s, s->rcv_base, packet->seqnum)) {
+      /* SR: Accept packet in window and send ACK for it */
+      LOG(LOG_RCV, 1, LOGC_RCV_OK, packet->seqnum, 0, 0);
+      packets_received++;
+
+      /* ACK the received packet (before ownership moves) */
+      acknum = packet->seqnum;
+
+      /* Park the packet in the ring if not already received */
+      packet_index = packet->seqnum & s->slotmask;
+      if (s->rcv_acked[packet_index]) {
+        pkt_free(packet);   /* duplicate of a buffered packet */
+      } else {
+        s->rcv_buffer[packet_index] = packet;
+        s->rcv_acked[packet_index] = true;
+        s->rcv_gen++;       /* window contents changed */
+      }
+
+      /* Deliver in-order packets to layer 5 */
+      drain_rcv_window(s, B);
+    } else {
+      /* Packet is outside our window - could be a duplicate */
+      LOG(LOG_RCV, 1, LOGC_RCV_OUTSIDE, packet->seqnum, 0, 0);
+
+      /* For SR, still ACK this packet (even if it's before our window) */
+      acknum = packet->seqnum;
+      pkt_free(packet);
+    }
+  } else {
+    /* Packet is corrupted */
+    LOG(LOG_RCV, 1, LOGC_RCV_CORRUPT, packet->seqnum, 0, 0);
+
+    /* No valid ACK to send */
+    if (s->rcv_base == 0)
+      acknum = s->seqspace - 1;
+    else
+      acknum = s->rcv_base - 1;
+    pkt_free(packet);
+  }
+
+  /* send out the ACK, from the cache when it is still valid */
+  send_ack(s, B, acknum);
+}
+
+/* by-value compatibility wrapper */
+void B_input(struct pkt packet)
+{
+  struct pkt *p = pkt_alloc();
+  *p = packet;
+  B_input_pkt(p);
+}
+
+/* schedule an ACK for seq at entity me: hold it hoping a reverse
+   data packet will carry it, but never hold more than one - a second
+   arrival flushes the older ACK immediately */
+static void schedule_ack(int me, int seq)
+{
+  if (!ack_pending[me]) {
+    pending_ack[me] = seq;
+    ack_pending[me] = true;
+    starttimer(me, DELACK_TIMEOUT);
+  } else {
+    send_standalone_ack(me);
+    pending_ack[me] = seq;   /* the running timer now covers this ACK */
+    ack_pending[me] = true;
+  }
+}
+
+/* data packet arriving at entity me on direction s; takes ownership */
+static void receive_data(struct sr_state *s, int me, struct pkt *packet)
+{
+  int packet_index;
+
+  if (in_window(s, s->rcv_base, packet->seqnum)) {
+    LOG(LOG_RCV, 1, LOGC_RCV_OK, packet->seqnum, 0, 0);
+    if (me == B)
+      packets_received++;   /* the terminal counters report B's side */
+    schedule_ack(me, packet->seqnum);
+
+    /* Park the packet in the ring if not already received */
+    packet_index = packet->seqnum & s->slotmask;
+    if (s->rcv_acked[packet_index]) {
+      pkt_free(packet);   /* duplicate of a buffered packet */
+    } else {
+      s->rcv_buffer[packet_index] = packet;
+      s->rcv_acked[packet_index] = true;
+      s->rcv_gen++;
+    }
+
+    /* Deliver in-order packets to layer 5 */
+    drain_rcv_window(s, me);
+  } else {
+    /* outside the window - a duplicate; re-ACK it anyway */
+    LOG(LOG_RCV, 1, LOGC_RCV_OUTSIDE, packet->seqnum, 0, 0);
+    schedule_ack(me, packet->seqnum);
+    pkt_free(packet);
+  }
+}
+
+/* bidirectional input: any packet can carry data (seqnum), an ACK for
+   my own outstanding data (acknum), or both */
+static void bidir_input(int me, struct pkt *packet)
+{
+  struct sr_state *snd = (me == A) ? srs : &sr_reverse;   /* data I sent */
+  struct sr_state *rcv = (me == A) ? &sr_reverse : srs;   /* data I receive */
+
+  if (IsCorrupted(*packet)) {
+    LOG(LOG_RCV, 1, LOGC_RCV_CORRUPT, packet->seqnum, 0, 0);
+    pkt_free(packet);   /* the senders' timers recover both halves */
+    return;
+  }
+
+  if (packet->acknum != NOTINUSE)
+    process_ack(snd, me, packet);
+
+  if (packet->seqnum != NOTINUSE)
+    receive_data(rcv, me, packet);   /* takes ownership */
+  else
+    pkt_free(packet);                /* standalone ACK */
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+void B_init(void)
+{
+  struct sr_state *s = sr_cur();
+
+  if (s->windowsize == 0)
+    SR_configure(0, 0);   /* driver never configured us: use defaults */
+
+  init_receiver_half(s);
+  if (bidirectional) {
+    /* B also originates the reverse connection */
+    init_sender_half(&sr_reverse);
+    ack_pending[B] = false;
+    pending_ack[B] = NOTINUSE;
+  }
+}
+
+/******************************************************************************
+ * The remaining entry points carry the B-to-A half of bidirectional mode     *
+ *****************************************************************************/
+
+/* layer 5 message to send from B; only arrives in bidirectional mode */
+void B_output(struct msg message)
+{
+  if (bidirectional)
+    output_msg(&sr_reverse, B, &message);
+}
+
+/* B's per-entity timer: the delayed-ACK timer in bidirectional mode */
+void B_timerinterrupt(void)
+{
+  if (bidirectional && ack_pending[B])
+    send_standalone_ack(B);
+}
+
+/* a per-packet timer for one of B's data packets expired */
+void B_packettimeout(int seqnum)
+{
+  if (bidirectional)
+    packet_timeout(&sr_reverse, B, seqnum);
+}
+
+/***************** checkpoint and restore *********************/
+/* Serialization for the emulator's checkpoint facility (-K/-X): one
+   fixed record of scalars per direction followed by the window arrays
+   and the parked receive-side packets.  The ACK cache is deliberately
+   not written - entries rebuild lazily on the first duplicate after a
+   restore.  Retransmission timers are not protocol state here; they
+   live in the emulator's event heap and are restored with it. */
+struct sr_ckpt {
+  int windowsize;
+  int seqspace;
+  int sack;
+  int cc;
+  int cum;
+  int nak;
+  int send_base;
+  int A_nextseqnum;
+  int windowcount;
+  float srtt;
+  float rttvar;
+  float rto;
+  float cwnd;
+  float ssthresh;
+  int dupacks;
+  int sendq_len;
+  int rcv_base;
+  int B_nextseqnum;
+  int nparked;           /* occupied receive slots that follow */
+  int rasm_len;          /* bytes of partial reassembled message that follow */
+};
+
+static void checkpoint_state(struct sr_state *s, FILE *f)
+{
+  struct sr_ckpt c;
+  int i;
+
+  memset(&c, 0, sizeof(c));
+  c.windowsize = s->windowsize;
+  c.seqspace = s->seqspace;
+  c.sack = sack_enabled;
+  c.cc = cc_enabled;
+  c.cum = cum_enabled;
+  c.nak = nak_enabled;
+  c.send_base = s->send_base;
+  c.A_nextseqnum = s->A_nextseqnum;
+  c.windowcount = s->windowcount;
+  c.srtt = s->srtt;
+  c.rttvar = s->rttvar;
+  c.rto = s->rto;
+  c.cwnd = s->cwnd;
+  c.ssthresh = s->ssthresh;
+  c.dupacks = s->dupacks;
+  c.sendq_len = s->sendq_len;
+  c.rcv_base = s->rcv_base;
+  c.B_nextseqnum = s->B_nextseqnum;
+  c.nparked = 0;
+  for (i = 0; i < s->windowsize; i++)
+    if (s->rcv_buffer[i] != NULL)
+      c.nparked++;
+  c.rasm_len = s->rasm_len;
+  fwrite(&c, sizeof(c), 1, f);
+
+  fwrite(s->buffer, sizeof(struct pkt), s->windowsize, f);
+  fwrite(s->ack_bits, sizeof(unsigned long long), s->ack_words, f);
+  fwrite(s->sendtime, sizeof(float), s->windowsize, f);
+  fwrite(s->retxed, sizeof(bool), s->windowsize, f);
+  for (i = 0; i < s->sendq_len; i++)
+    fwrite(&s->sendq[(s->sendq_head + i) & (SENDQ_CAP - 1)],
+           sizeof(struct msg), 1, f);
+  fwrite(s->rcv_acked, sizeof(bool), s->windowsize, f);
+  for (i = 0; i < s->windowsize; i++) {
+    if (s->rcv_buffer[i] != NULL) {
+      fwrite(&i, sizeof(i), 1, f);
+      fwrite(s->rcv_buffer[i], sizeof(struct pkt), 1, f);
+    }
+  }
+  if (s->rasm_len > 0)
+    fwrite(s->rasm, 1, s->rasm_len, f);
+}
+
+static void restore_state(struct sr_state *s, FILE *f)
+{
+  struct sr_ckpt c;
+  int i, slot;
+
+  if (fread(&c, sizeof(c), 1, f) != 1) {
+    printf("restore: protocol state is truncated\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* allocate at the snapshot's sizes, then overwrite the contents */
+  configure_state(s, c.windowsize, c.seqspace);
+  init_sender_half(s);
+  init_receiver_half(s);
+  sack_enabled = c.sack;
+  cc_enabled = c.cc;
+  cum_enabled = c.cum;
+  nak_enabled = c.nak;
+  s->send_base = c.send_base;
+  s->A_nextseqnum = c.A_nextseqnum;
+  s->windowcount = c.windowcount;
+  s->srtt = c.srtt;
+  s->rttvar = c.rttvar;
+  s->rto = c.rto;
+  s->cwnd = c.cwnd;
+  s->ssthresh = c.ssthresh;
+  s->dupacks = c.dupacks;
+  s->rcv_base = c.rcv_base;
+  s->B_nextseqnum = c.B_nextseqnum;
+
+  if (fread(s->buffer, sizeof(struct pkt), s->windowsize, f)
+          != (size_t)s->windowsize ||
+      fread(s->ack_bits, sizeof(unsigned long long), s->ack_words, f)
+          != (size_t)s->ack_words ||
+      fread(s->sendtime, sizeof(float), s->windowsize, f)
+          != (size_t)s->windowsize ||
+      fread(s->retxed, sizeof(bool), s->windowsize, f)
+          != (size_t)s->windowsize ||
+      (c.sendq_len > 0 &&
+       fread(s->sendq, sizeof(struct msg), c.sendq_len, f)
+          != (size_t)c.sendq_len) ||
+      fread(s->rcv_acked, sizeof(bool), s->windowsize, f)
+          != (size_t)s->windowsize) {
+    printf("restore: protocol state is truncated\n");
+    exit(EXIT_FAILURE);
+  }
+  s->sendq_head = 0;
+  s->sendq_len = c.sendq_len;
+
+  for (i = 0; i < c.nparked; i++) {
+    if (fread(&slot, sizeof(slot), 1, f) != 1 ||
+        slot < 0 || slot >= s->windowsize) {
+      printf("restore: protocol state is truncated\n");
+      exit(EXIT_FAILURE);
+    }
+    s->rcv_buffer[slot] = pkt_alloc();
+    if (fread(s->rcv_buffer[slot], sizeof(struct pkt), 1, f) != 1) {
+      printf("restore: protocol state is truncated\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (c.rasm_len > 0) {
+    if (c.rasm_len > MSG_MAXLEN) {
+      printf("restore: protocol state is truncated\n");
+      exit(EXIT_FAILURE);
+    }
+    free(s->rasm);
+    s->rasm = malloc(c.rasm_len);
+    if (s->rasm == NULL) {
+      printf("memory allocation for reassembly buffer failed.");
+      exit(EXIT_FAILURE);
+    }
+    s->rasm_cap = c.rasm_len;
+    if (fread(s->rasm, 1, c.rasm_len, f) != (size_t)c.rasm_len) {
+      printf("restore: protocol state is truncated\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  s->rasm_len = c.rasm_len;
+}
+
+void SR_checkpoint(FILE *f)
+{
+  int i;
+
+  if (sr_nflows > 1) {
+    for (i = 0; i < sr_nflows; i++)
+      checkpoint_state(&flow_states[i], f);
+    return;   /* bidirectional mode is single-flow only */
+  }
+  checkpoint_state(sr_cur(), f);
+  if (bidirectional) {
+    checkpoint_state(&sr_reverse, f);
+    fwrite(pending_ack, sizeof(pending_ack), 1, f);
+    fwrite(ack_pending, sizeof(ack_pending), 1, f);
+  }
+}
+
+void SR_restore(FILE *f)
+{
+  int i;
+
+  if (sr_nflows > 1) {
+    SR_select_flow(0);   /* allocates the flow array on first use */
+    for (i = 0; i < sr_nflows; i++)
+      restore_state(&flow_states[i], f);
+    return;
+  }
+  restore_state(sr_cur(), f);
+  if (bidirectional) {
+    restore_state(&sr_reverse, f);
+    if (fread(pending_ack, sizeof(pending_ack), 1, f) != 1 ||
+        fread(ack_pending, sizeof(ack_pending), 1, f) != 1) {
+      printf("restore: protocol state is truncated\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/* Microbenchmark drivers (the emulator's -Y mode): run one protocol
+   primitive in a tight loop on synthetic state, so its cost can be
+   timed in isolation from the scheduler.  Each returns an accumulator
+   the caller folds into its report, which also keeps the compiler from
+   discarding the loop. */
+
+long SR_bench_window(int windowsize, int seqspace, long iters)
+{
+  struct sr_state s;
+  long hits = 0;
+  long i;
+  int base = 0;
+
+  memset(&s, 0, sizeof(s));
+  configure_state(&s, windowsize, seqspace);
+  for (i = 0; i < iters; i++) {
+    if (in_window(&s, base, (int)i & s.seqmask))
+      hits++;
+    base = (base + 1) & s.seqmask;   /* exercise the wraparound arm too */
+  }
+  return hits;
+}
+
+long SR_bench_advance(int windowsize, long iters)
+{
+  struct sr_state s;
+  long advanced = 0;
+  long i;
+  int w;
+
+  memset(&s, 0, sizeof(s));
+  configure_state(&s, windowsize, 0);
+  s.ack_words = (s.windowsize + 63) >> 6;
+  s.ack_bits = calloc(s.ack_words, sizeof(unsigned long long));
+  if (s.ack_bits == NULL) {
+    printf("memory allocation for the advance benchmark failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < iters; i++) {
+    /* full window with every slot but the last ACKed: one iteration
+       scans and clears windowsize-1 slots word at a time */
+    for (w = 0; w < s.ack_words; w++)
+      s.ack_bits[w] = ~0ULL;
+    ack_clear(&s, s.windowsize - 1);
+    s.send_base = 0;
+    s.windowcount = s.windowsize;
+    advance_send_base(&s);
+    advanced += s.send_base;
+  }
+  free(s.ack_bits);
+  return advanced;
+}
@@ -1,11 +1,76 @@
-extern void A_init(void);
-extern void B_init(void);
-extern void A_input(struct pkt);
-extern void B_input(struct pkt);
-extern void A_output(struct msg);
-extern void A_timerinterrupt(void);
-
-/* included for extension to bidirectional communication */
-#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
-extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+#include <stdio.h>   /* FILE, for SR_checkpoint()/SR_restore() */
+
+/* set window size and sequence space before A_init()/B_init() run;
+   both round up to powers of two, seqspace to at least 2*windowsize.
+   Pass 0 to get the defaults. */
+extern void SR_configure(int windowsize, int seqspace);
+
+/* enable SACK mode: B's ACK payloads carry a bitmap of its receive
+   window and A marks every covered packet per ACK */
+extern void SR_enable_sack(int on);
+
+/* enable congestion control: slow start / AIMD / fast recovery caps
+   how much of the send window A will fill */
+extern void SR_enable_cc(int on);
+
+/* enable cumulative-ACK hybrid mode: B's ACK seqnum carries its
+   rcv_base and A releases everything below that edge in one step */
+extern void SR_enable_cumack(int on);
+
+/* enable NAK mode: B's ACK payloads carry a bitmap of the holes in
+   its receive window and A resends them without waiting for a timer */
+extern void SR_enable_nak(int on);
+
+/* multi-flow engine: n independent SR connections share the channel.
+   SR_set_nflows() fixes the flow count before any init; the emulator
+   selects the flow matching each event before calling the role-based
+   A/B entry points.  One flow is the classic two-entity setup. */
+extern void SR_set_nflows(int n);
+extern void SR_select_flow(int f);
+
+/* checksum kernels: PayloadDigest() sums the 20 payload bytes in wide
+   lanes; ChecksumWithDigest() folds header fields into a digest so a
+   constant payload need not be rehashed per packet */
+extern int PayloadDigest(const char payload[20]);
+extern int ChecksumWithDigest(int seqnum, int acknum, int payload_digest);
+extern int ComputeChecksum(struct pkt);
+
+extern void A_init(void);
+extern void B_init(void);
+extern void A_input(struct pkt);
+extern void B_input(struct pkt);
+
+/* zero-copy entry points used by the emulator main loop; the callee
+   takes ownership of the pool packet (stores it or recycles it) */
+extern void A_input_pkt(struct pkt *);
+extern void B_input_pkt(struct pkt *);
+extern void A_output(struct msg);
+
+/* segmentation layer above A_output(): splits one application message
+   of 1..MSG_MAXLEN bytes into 20-byte segments, each taking a window
+   slot, and refuses the whole message (counted as window_full) when
+   window plus send queue cannot hold every segment - a partial message
+   would reassemble wrongly at the far side.  B_output_data() is the
+   reverse-direction twin for bidirectional mode. */
+extern void A_output_data(const char *, int);
+extern void B_output_data(const char *, int);
+extern void A_timerinterrupt(void);
+
+/* called when the per-packet timer for seqnum expires */
+extern void A_packettimeout(int);
+extern void B_packettimeout(int);
+
+/* bidirectional mode (the emulator's runtime `bidirectional` flag):
+   B runs a reverse-direction sender and ACKs ride on data packets */
+extern void B_output(struct msg);
+extern void B_timerinterrupt(void);
+
+/* serialize/restore all protocol state for the emulator's checkpoint
+   facility (-K/-X); the stream position is advanced past the record */
+extern void SR_checkpoint(FILE *);
+extern void SR_restore(FILE *);
+
+/* microbenchmark drivers (-Y): iterate one primitive on synthetic
+   state; the returned accumulator defeats dead-code elimination */
+extern long SR_bench_window(int windowsize, int seqspace, long iters);
+extern long SR_bench_advance(int windowsize, long iters);
\ No newline at end of file
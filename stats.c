@@ -0,0 +1,268 @@
+/* Instrumentation module (see stats.h).
+   Latencies go into an HDR-style histogram: a power-of-two bucket per
+   value magnitude, split into HIST_SUB linear sub-buckets, so relative
+   error is bounded (~3%) across the whole range while recording stays
+   a shift, a mask and one increment.  Send stamps ride a FIFO ring:
+   Selective Repeat delivers messages to layer 5 in the order layer 5
+   handed them down, so delivery always completes the oldest stamp.
+   State is thread-local like the rest of the per-run state. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "stats.h"
+
+#define HIST_EXPS 32     /* power-of-two magnitude buckets */
+#define HIST_SUB  16     /* linear sub-buckets per magnitude */
+
+#define STAMP_RING 4096  /* initial stamp ring capacity; grows by doubling */
+
+int stats_enabled = 0;
+
+static __thread long hist[HIST_EXPS][HIST_SUB];
+static __thread long hist_count;
+static __thread double hist_sum;
+static __thread float hist_max;
+
+static __thread float *stamp;
+static __thread int stamp_cap;                /* power of two */
+static __thread int stamp_head, stamp_tail;   /* pop at head, push at tail */
+
+/* (time, occupancy) samples; grows by doubling, appended per A_output */
+static __thread float *occ_time;
+static __thread int *occ_val;
+static __thread int occ_len, occ_cap;
+
+/* retransmissions per sequence number; grows to the seqspace in use */
+static __thread long *retx;
+static __thread int retx_cap;
+
+void stats_reset(void)
+{
+  memset(hist, 0, sizeof(hist));
+  hist_count = 0;
+  hist_sum = 0.0;
+  hist_max = 0.0;
+  stamp_head = stamp_tail = 0;
+  occ_len = 0;
+  if (retx != NULL)
+    memset(retx, 0, retx_cap * sizeof(long));
+}
+
+void stats_msg_sent(float now)
+{
+  float *grown;
+  int len, i;
+
+  if (!stats_enabled)
+    return;
+  if (stamp == NULL) {
+    stamp_cap = STAMP_RING;
+    stamp = malloc(stamp_cap * sizeof(float));
+    if (stamp == NULL) {
+      printf("memory allocation for stats stamps failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  /* ring full (large windows or a deep send queue keep that many
+     messages in flight): unwrap into a doubled array, oldest first */
+  if (((stamp_tail + 1) & (stamp_cap - 1)) == stamp_head) {
+    grown = malloc(stamp_cap * 2 * sizeof(float));
+    if (grown == NULL) {
+      printf("memory allocation for stats stamps failed.");
+      exit(EXIT_FAILURE);
+    }
+    len = 0;
+    for (i = stamp_head; i != stamp_tail; i = (i + 1) & (stamp_cap - 1))
+      grown[len++] = stamp[i];
+    free(stamp);
+    stamp = grown;
+    stamp_cap *= 2;
+    stamp_head = 0;
+    stamp_tail = len;
+  }
+  stamp[stamp_tail] = now;
+  stamp_tail = (stamp_tail + 1) & (stamp_cap - 1);
+}
+
+void stats_msg_undo(void)
+{
+  if (!stats_enabled)
+    return;
+  stamp_tail = (stamp_tail - 1) & (stamp_cap - 1);
+}
+
+/* map a latency to its histogram cell */
+static void hist_record(float latency)
+{
+  int e, sub;
+
+  if (latency < 0)
+    latency = 0;
+  e = (latency < 1.0f) ? 0 : ilogbf(latency) + 1;
+  if (e >= HIST_EXPS)
+    e = HIST_EXPS - 1;
+  /* linear position within [2^(e-1), 2^e) */
+  sub = (e == 0) ? (int)(latency * HIST_SUB)
+                 : (int)((latency / ldexpf(1.0f, e - 1) - 1.0f) * HIST_SUB);
+  if (sub < 0)
+    sub = 0;
+  if (sub >= HIST_SUB)
+    sub = HIST_SUB - 1;
+  hist[e][sub]++;
+  hist_count++;
+  hist_sum += latency;
+  if (latency > hist_max)
+    hist_max = latency;
+}
+
+void stats_msg_delivered(float now)
+{
+  float sent;
+
+  if (!stats_enabled)
+    return;
+  if (stamp_head == stamp_tail)
+    return;   /* delivery with no outstanding stamp: replay mode */
+  sent = stamp[stamp_head];
+  stamp_head = (stamp_head + 1) & (stamp_cap - 1);
+  hist_record(now - sent);
+}
+
+void stats_window_sample(float now, int occupancy)
+{
+  if (!stats_enabled)
+    return;
+  if (occ_len == occ_cap) {
+    occ_cap = (occ_cap == 0) ? 1024 : occ_cap*2;
+    occ_time = realloc(occ_time, occ_cap * sizeof(float));
+    occ_val = realloc(occ_val, occ_cap * sizeof(int));
+    if (occ_time == NULL || occ_val == NULL) {
+      printf("memory allocation for stats samples failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  occ_time[occ_len] = now;
+  occ_val[occ_len] = occupancy;
+  occ_len++;
+}
+
+void stats_retransmit(int seqnum)
+{
+  int cap, newcap;
+
+  if (!stats_enabled)
+    return;
+  cap = retx_cap;
+  if (seqnum >= cap) {
+    newcap = (cap == 0) ? 64 : cap;
+    while (newcap <= seqnum)
+      newcap *= 2;
+    retx = realloc(retx, newcap * sizeof(long));
+    if (retx == NULL) {
+      printf("memory allocation for stats counters failed.");
+      exit(EXIT_FAILURE);
+    }
+    while (cap < newcap)
+      retx[cap++] = 0;
+    retx_cap = newcap;
+  }
+  retx[seqnum]++;
+}
+
+/* lower edge of histogram cell (e, sub) */
+static float cell_edge(int e, int sub)
+{
+  if (e == 0)
+    return (float)sub / HIST_SUB;
+  return ldexpf(1.0f, e - 1) * (1.0f + (float)sub / HIST_SUB);
+}
+
+/* value at or below which frac of recorded latencies fall */
+static float hist_percentile(double frac)
+{
+  long target = (long)(frac * hist_count);
+  long seen = 0;
+  int e, sub;
+
+  for (e = 0; e < HIST_EXPS; e++)
+    for (sub = 0; sub < HIST_SUB; sub++) {
+      seen += hist[e][sub];
+      if (seen >= target)
+        return cell_edge(e, sub);
+    }
+  return hist_max;
+}
+
+/* collapse the histogram for the binary results writer: one total per
+   power-of-two magnitude row */
+void stats_latency_snapshot(long *count, double *sum, float *max,
+                            long mag[HIST_EXPS])
+{
+  int e, s;
+
+  *count = hist_count;
+  *sum = hist_sum;
+  *max = hist_max;
+  for (e = 0; e < HIST_EXPS; e++) {
+    mag[e] = 0;
+    for (s = 0; s < HIST_SUB; s++)
+      mag[e] += hist[e][s];
+  }
+}
+
+void stats_export(const char *prefix)
+{
+  char path[256];
+  FILE *f;
+  int e, sub, i;
+
+  if (!stats_enabled)
+    return;
+
+  if (hist_count > 0)
+    printf("# latency: n %ld mean %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+           hist_count, hist_sum/hist_count,
+           hist_percentile(0.50), hist_percentile(0.90),
+           hist_percentile(0.99), hist_max);
+
+  snprintf(path, sizeof(path), "%s_latency.csv", prefix);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    printf("stats: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "latency_low,latency_high,count\n");
+  for (e = 0; e < HIST_EXPS; e++)
+    for (sub = 0; sub < HIST_SUB; sub++)
+      if (hist[e][sub] > 0)
+        fprintf(f, "%g,%g,%ld\n", cell_edge(e, sub),
+                (sub == HIST_SUB-1) ? cell_edge(e+1, 0) : cell_edge(e, sub+1),
+                hist[e][sub]);
+  fclose(f);
+
+  snprintf(path, sizeof(path), "%s_window.csv", prefix);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    printf("stats: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "time,window_occupancy\n");
+  for (i = 0; i < occ_len; i++)
+    fprintf(f, "%f,%d\n", occ_time[i], occ_val[i]);
+  fclose(f);
+
+  snprintf(path, sizeof(path), "%s_retx.csv", prefix);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    printf("stats: cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "seqnum,retransmissions\n");
+  for (i = 0; i < retx_cap; i++)
+    if (retx[i] > 0)
+      fprintf(f, "%d,%ld\n", i, retx[i]);
+  fclose(f);
+}
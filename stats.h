@@ -0,0 +1,40 @@
+/* Instrumentation beyond the terminal counters: per-message layer5 to
+   layer5 delivery latency (HDR-style histogram), send-window occupancy
+   over time, and retransmission counts per sequence number.  Recording
+   is a few array writes per event and everything is sized or grown
+   off the hot path; with stats disabled each hook is one untaken
+   branch.  Exported as CSV files at termination. */
+
+#ifndef STATS_H
+#define STATS_H
+
+extern int stats_enabled;
+
+extern void stats_reset(void);
+
+/* a message was handed to the sender at time now */
+extern void stats_msg_sent(float now);
+
+/* the most recently stamped message was dropped (window full) */
+extern void stats_msg_undo(void);
+
+/* the oldest outstanding message reached layer 5 at the receiver */
+extern void stats_msg_delivered(float now);
+
+/* send-window occupancy after a layer 5 arrival at A */
+extern void stats_window_sample(float now, int occupancy);
+
+/* packet seqnum was retransmitted */
+extern void stats_retransmit(int seqnum);
+
+/* print a latency summary and write <prefix>_latency.csv,
+   <prefix>_window.csv and <prefix>_retx.csv */
+extern void stats_export(const char *prefix);
+
+/* snapshot the latency histogram for the binary results writer: sample
+   count, latency sum, max, and the 32 magnitude rows collapsed to
+   per-magnitude totals.  All zero while recording is disabled. */
+extern void stats_latency_snapshot(long *count, double *sum, float *max,
+                                   long mag[32]);
+
+#endif /* STATS_H */